@@ -11,20 +11,27 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <memory>
+#include <vector>
+#include <sstream>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistics.h"
+#include "archive.h"
+#include "metrics.h"
+#include "external.h"
+#include "trainer.h"
+#include "perft.h"
+#include "play.h"
 
 int main(int argc, const char* argv[]) {
-	std::cout << "2048 Demo: ";
-	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
-	std::cout << std::endl << std::endl;
-
-	size_t total = 1000, block = 0, limit = 0;
+	size_t total = 1000, block = 0, limit = 0, games = 1;
+	bool serve = false;
 	std::string slide_args, place_args;
-	std::string load_path, save_path;
+	std::string load_path, save_path, query;
+	std::string metrics_args, train_path, perft_args, pipeline_args;
 	for (int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		auto match_arg = [&](std::string flag) -> bool {
@@ -49,46 +56,110 @@ int main(int argc, const char* argv[]) {
 			load_path = next_opt();
 		} else if (match_arg("save")) {
 			save_path = next_opt();
+		} else if (match_arg("query")) {
+			query = next_opt();
+		} else if (match_arg("metrics")) {
+			metrics_args = next_opt();
+		} else if (match_arg("train")) {
+			train_path = next_opt();
+		} else if (match_arg("games")) {
+			games = std::max(std::stoull(next_opt()), 1ull);
+		} else if (match_arg("pipeline")) {
+			pipeline_args = next_opt();
+		} else if (match_arg("perft")) {
+			perft_args = next_opt();
+		} else if (match_arg("serve")) {
+			serve = true;
 		}
 	}
 
+	if (serve) { // serve the slider as an external agent through stdin/stdout
+		random_slider slide(slide_args);
+		external_agent::serve(slide);
+		return 0;
+	}
+
+	std::cout << "2048 Demo: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
+	std::cout << std::endl << std::endl;
+
+	if (query.size()) {
+		if (load_path.empty()) {
+			std::cerr << "--query requires --load" << std::endl;
+			return -1;
+		}
+		try {
+			archive arc(load_path);
+			std::vector<size_t> match = arc.select(query);
+			std::cout << match.size() << " of " << arc.count() << " episodes matched" << std::endl << std::endl;
+			arc.show(match);
+			if (save_path.size()) {
+				statistics stats(0);
+				for (size_t id : match) stats.push_back(arc.fetch(arc.at(id)));
+				archive::save(stats, save_path);
+			}
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (perft_args.size()) { // enumerate the states from a board, or verify the reference counts
+		if (perft_args == "check") return perft::check() ? 0 : 1;
+		unsigned depth = 4, threads = std::thread::hardware_concurrency();
+		bool slide = true, unique = true;
+		board root;
+		std::stringstream ss(perft_args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			std::string value = pair.substr(pair.find('=') + 1);
+			if (key == "depth") depth = std::stoul(value);
+			if (key == "board") std::stringstream(value) >> root;
+			if (key == "turn") slide = (value != "place");
+			if (key == "threads") threads = std::stoul(value);
+			if (key == "unique") unique = (value != "0");
+		}
+		std::cout << root;
+		perft::show(perft(root, slide, threads).run(depth, unique));
+		return 0;
+	}
+
 	statistics stats(total, block, limit);
 
 	if (load_path.size()) {
-		std::ifstream in(load_path, std::ios::in);
-		in >> stats;
-		in.close();
+		stats.load(load_path);
 		if (stats.is_finished()) stats.summary();
 	}
 
-	random_slider slide(slide_args);
-	random_placer place(place_args);
-
-	while (!stats.is_finished()) {
-//		std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
-		slide.open_episode("~:" + place.name());
-		place.open_episode(slide.name() + ":~");
+	metrics monitor(metrics_args);
+	std::unique_ptr<agent> slider;
+	if (slide_args.find("exec=") != std::string::npos) {
+		slider.reset(new external_agent(slide_args));
+	} else if (slide_args.find("tuple=") != std::string::npos) {
+		slider.reset(new greedy_slider(slide_args));
+	} else {
+		slider.reset(new random_slider(slide_args));
+	}
+	agent& slide = *slider;
 
-		stats.open_episode(slide.name() + ":" + place.name());
-		episode& game = stats.back();
-		while (true) {
-			agent& who = game.take_turns(slide, place);
-			action move = who.take_action(game.state());
-//			std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
-			if (game.apply_action(move) != true) break;
-			if (who.check_for_win(game.state())) break;
-		}
-		agent& win = game.last_turns(slide, place);
-		stats.close_episode(win.name());
+	if (train_path.size()) { // offline training from saved episodes
+		weight_agent* learner = dynamic_cast<weight_agent*>(slider.get());
+		if (!learner) throw std::invalid_argument("offline training requires a slider with weight tables");
+		offline_trainer(*learner).train(train_path);
+	}
+	random_placer place(place_args);
 
-		slide.close_episode(win.name());
-		place.close_episode(win.name());
+	if (pipeline_args.size()) { // actor threads play, while this thread learns
+		greedy_slider* learner = dynamic_cast<greedy_slider*>(slider.get());
+		if (!learner) throw std::invalid_argument("pipelined training requires a slider with an n-tuple network");
+		pipeline_trainer(*learner, pipeline_args).run(stats, place_args);
+	} else {
+		game_loop(slide, place, games).run(stats);
 	}
 
 	if (save_path.size()) {
-		std::ofstream out(save_path, std::ios::out | std::ios::trunc);
-		out << stats;
-		out.close();
+		archive::save(stats, save_path);
 	}
 
 	return 0;
@@ -41,6 +41,17 @@ public:
 		}
 		return in.ignore(2);
 	}
+	/**
+	 * decode an action from the text [in, end) in the same format as operator <<
+	 * return the position after the action, which skips 2 characters if the text is unrecognized
+	 */
+	virtual const char* decode(const char* in, const char* end) {
+		for (auto proto = entries().begin(); proto != entries().end(); proto++) {
+			const char* next = proto->second->reinterpret(this).decode(in, end);
+			if (next) return next;
+		}
+		return std::min(in + 2, end);
+	}
 
 public:
 	operator unsigned() const { return code; }
@@ -85,6 +96,17 @@ public:
 		in.setstate(std::ios::failbit);
 		return in;
 	}
+	const char* decode(const char* in, const char* end) {
+		if (end - in >= 2 && in[0] == '#') {
+			const char* opc = "URDL";
+			unsigned oper = std::find(opc, opc + 4, in[1]) - opc;
+			if (oper < 4) {
+				operator= (action::slide(oper));
+				return in + 2;
+			}
+		}
+		return nullptr;
+	}
 protected:
 	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) slide(*a); }
 	static __attribute__((constructor)) void init() { entries()[type_flag('s')] = new slide; }
@@ -93,10 +115,10 @@ protected:
 class action::place : public action {
 public:
 	static constexpr unsigned type = type_flag('p');
-	place(unsigned pos, unsigned tile) : action(place::type | (pos & 0x0f) | (std::min(tile, 35u) << 4)) {}
+	place(unsigned pos, unsigned tile) : action(place::type | (pos & 0x3f) | (std::min(tile, 35u) << 6)) {}
 	place(const action& a = {}) : action(a) {}
-	unsigned position() const { return event() & 0x0f; }
-	unsigned tile() const { return event() >> 4; }
+	unsigned position() const { return event() & 0x3f; }
+	unsigned tile() const { return event() >> 6; }
 public:
 	board::reward apply(board& b) const {
 		return b.place(position(), tile());
@@ -109,10 +131,10 @@ public:
 		const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 		if (in.peek() != '#' && in) {
 			char v = in.peek();
-			unsigned pos = std::find(idx, idx + 16, v) - idx;
+			unsigned pos = std::find(idx, idx + board::size, v) - idx;
 			in.ignore(1) >> v;
 			unsigned tile = std::find(idx, idx + 36, v) - idx;
-			if (pos < 16 && tile < 36) {
+			if (pos < board::size && tile < 36) {
 				operator =(action::place(pos, tile));
 				return in;
 			}
@@ -120,6 +142,18 @@ public:
 		in.setstate(std::ios::failbit);
 		return in;
 	}
+	const char* decode(const char* in, const char* end) {
+		const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+		if (end - in >= 2 && in[0] != '#') {
+			unsigned pos = std::find(idx, idx + board::size, in[0]) - idx;
+			unsigned tile = std::find(idx, idx + 36, in[1]) - idx;
+			if (pos < board::size && tile < 36) {
+				operator =(action::place(pos, tile));
+				return in + 2;
+			}
+		}
+		return nullptr;
+	}
 protected:
 	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) place(*a); }
 	static __attribute__((constructor)) void init() { entries()[type_flag('p')] = new place; }
@@ -15,9 +15,15 @@
 #include <type_traits>
 #include <algorithm>
 #include <fstream>
+#include <atomic>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
 #include "board.h"
 #include "action.h"
 #include "weight.h"
+#include "cache.h"
+#include "profile.h"
 
 class agent {
 public:
@@ -35,11 +41,18 @@ public:
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
 
+	/**
+	 * take actions for a batch of boards, e.g., boards from concurrent games
+	 */
+	virtual void take_actions(const board* b, action* a, size_t n) {
+		for (size_t i = 0; i < n; i++) a[i] = take_action(b[i]);
+	}
+
 public:
-	virtual std::string property(const std::string& key) const { return meta.at(key); }
+	virtual const std::string& property(const std::string& key) const { return meta.at(key).value; }
 	virtual void notify(const std::string& msg) { meta[msg.substr(0, msg.find('='))] = { msg.substr(msg.find('=') + 1) }; }
-	virtual std::string name() const { return property("name"); }
-	virtual std::string role() const { return property("role"); }
+	virtual const std::string& name() const { return property("name"); }
+	virtual const std::string& role() const { return property("role"); }
 
 protected:
 	typedef std::string key;
@@ -69,42 +82,242 @@ protected:
 
 /**
  * base agent for agents with weight tables and a learning rate
+ *
+ * the weight tables form an n-tuple network if patterns are given, e.g.,
+ * tuple=0123,4567,89AB,CDEF,048C,159D,26AE,37BF (8x4-tuple, cells in base-36 digits)
+ * where table i is indexed by the tiles on the cells of pattern i (4 bits per cell),
+ * and its size is 16^k for a k-tuple if the sizes are not given by init
+ *
+ * tiles can be folded into a smaller alphabet to shrink the tables, e.g.,
+ * fold=11: tiles of 2048 and larger share one symbol, so a k-tuple takes 12^k entries
+ * the mapping is stored in the weight file, and is restored when the file is loaded
+ *
+ * the placement of weight tables can be tuned by
+ *  hugetlb=1: try explicit huge pages before transparent huge pages
+ *  numa=interleave: interleave tables over NUMA nodes (default: first-touch by each thread)
+ *  threads=N: the number of threads for initializing tables
+ *
+ * profile=PATH: profile the accesses to the tables, and write the report at exit, see profile.h
  */
 class weight_agent : public agent {
 public:
-	weight_agent(const std::string& args = "") : agent(args), alpha(0) {
+	weight_agent(const std::string& args = "") : agent(args), alpha(0), version(0), stale(1),
+		cache(meta.find("cache") != meta.end() ? size_t(int(meta["cache"])) : 0) {
+		if (meta.find("hugetlb") != meta.end())
+			placement::global().hugetlb = int(meta["hugetlb"]);
+		if (meta.find("numa") != meta.end())
+			placement::global().interleave = (meta["numa"].value == "interleave");
+		if (meta.find("threads") != meta.end())
+			placement::global().threads = std::max(int(meta["threads"]), 1);
+		init_fold(meta.find("fold") != meta.end() ? int(meta["fold"]) : 15);
+		if (meta.find("tuple") != meta.end())
+			init_patterns(meta["tuple"]);
 		if (meta.find("init") != meta.end())
 			init_weights(meta["init"]);
 		if (meta.find("load") != meta.end())
 			load_weights(meta["load"]);
 		if (meta.find("alpha") != meta.end())
 			alpha = float(meta["alpha"]);
+		if (meta.find("stale") != meta.end())
+			stale = std::max(int(meta["stale"]), 1);
+		for (size_t i = 0; i < patterns.size(); i++) {
+			if (i >= net.size() || net[i].size() < stride[patterns[i].size()])
+				throw std::invalid_argument("weight table " + std::to_string(i) + " is too small for its pattern");
+		}
+		if (meta.find("profile") != meta.end())
+			profile.attach(net);
 	}
 	virtual ~weight_agent() {
 		if (meta.find("save") != meta.end())
 			save_weights(meta["save"]);
+		if (cache.size()) report(std::cerr);
+		if (profile.enabled()) save_profile(meta["profile"]);
+	}
+
+	virtual void close_episode(const std::string& flag = "") {
+		if (profile.enabled()) profile.episode();
+	}
+
+public:
+	/**
+	 * a transition of an episode: the afterstate of an action, and the reward of the action
+	 */
+	struct transition {
+		board after;
+		board::reward reward;
+	};
+
+	/**
+	 * estimate the value of an afterstate, through the value cache if enabled
+	 * cached values are valid for the same epoch, which advances once per 'stale' updates
+	 */
+	virtual float estimate(const board& after) const {
+		uint32_t now = version.load(std::memory_order_acquire) / stale;
+		float value;
+		if (cache.find(after, now, value)) return value;
+		value = lookup(after);
+		cache.store(after, now, value);
+		return value;
+	}
+
+	/**
+	 * adjust the value of an afterstate by 'u' per table, and return the adjusted value
+	 * the tables may be read concurrently, but should be written by one thread at a time
+	 */
+	virtual float update(const board& after, float u) {
+		float value = 0;
+		for (size_t i = 0; i < patterns.size(); i++) {
+			size_t index = indexof(after, i);
+			if (profile.enabled()) profile.write(i, index);
+			float adjusted = net[i].load(index) + u;
+			net[i].store(index, adjusted);
+			value += adjusted;
+		}
+		version.fetch_add(1, std::memory_order_release);
+		return value;
+	}
+
+	/**
+	 * TD(0) learning over the transitions of an episode, backward from the end
+	 * V(s'(t)) <- V(s'(t)) + alpha * (r(t+1) + V(s'(t+1)) - V(s'(t)))
+	 */
+	virtual void learn(const transition* path, size_t n) {
+		float target = 0;
+		for (const transition* it = path + n; it != path; ) {
+			it--;
+			float error = target - lookup(it->after);
+			target = it->reward + update(it->after, alpha * error);
+		}
+		updates().fetch_add(n, std::memory_order_relaxed);
+	}
+
+	/**
+	 * the number of afterstates learned by all agents of the process
+	 */
+	static std::atomic<uint64_t>& updates() { static std::atomic<uint64_t> n(0); return n; }
+
+	float rate() const { return alpha; }
+
+	/**
+	 * report the hit rate of the value cache, and the table reads it saved
+	 */
+	void report(std::ostream& out) const {
+		uint64_t hit = value_cache::hits(), miss = value_cache::misses();
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(2);
+		out << name() << ": cache = " << cache.size() << " entries, " << hit << " hits, " << miss << " misses, ";
+		out << "hit rate = " << (hit * 100.0 / std::max(hit + miss, uint64_t(1))) << "%, ";
+		out << "table reads saved = " << (hit * patterns.size()) << std::endl;
+		out.copyfmt(ff);
 	}
 
 protected:
+	/**
+	 * the value of an afterstate, read from the tables directly
+	 */
+	float lookup(const board& after) const {
+		float value = 0;
+		for (size_t i = 0; i < patterns.size(); i++) {
+			size_t index = indexof(after, i);
+			if (profile.enabled()) profile.read(i, index);
+			value += net[i].load(index);
+		}
+		return value;
+	}
+
+	/**
+	 * the index of an afterstate in table i, where tiles are folded into symbols,
+	 * and the symbol of the k-th cell of the pattern is the k-th digit in base 'radix'
+	 */
+	size_t indexof(const board& after, size_t i) const {
+		size_t index = 0;
+		const std::vector<unsigned>& cells = patterns[i];
+		for (size_t k = 0; k < cells.size(); k++)
+			index += fold[std::min(after(cells[k]), 63u)] * stride[k];
+		return index;
+	}
+
+	/**
+	 * fold tiles larger than 'last' into the symbol of 'last', i.e., an alphabet of last + 1 symbols
+	 * the default (last = 15) gives 4 bits per cell
+	 */
+	void init_fold(unsigned last) {
+		last = std::min(std::max(last, 1u), 63u);
+		for (unsigned t = 0; t < fold.size(); t++) fold[t] = std::min(t, last);
+		init_stride();
+	}
+	void init_stride() {
+		radix = *std::max_element(fold.begin(), fold.end()) + 1;
+		stride.assign(1, 1);
+		for (unsigned k = 0; k < board::size; k++)
+			stride.push_back(stride.back() <= (-1ull) / radix ? stride.back() * radix : -1ull);
+	}
+
+	virtual void init_patterns(const std::string& info) {
+		const std::string idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+		std::stringstream in(info); // comma-separated patterns, e.g., "0123,4567"
+		for (std::string token; std::getline(in, token, ','); ) {
+			std::vector<unsigned> cells;
+			for (char ch : token) {
+				size_t pos = idx.find(std::toupper(ch));
+				if (pos >= board::size) throw std::invalid_argument("invalid pattern: " + token);
+				cells.push_back(pos);
+			}
+			patterns.push_back(cells);
+		}
+	}
 	virtual void init_weights(const std::string& info) {
 		std::string res = info; // comma-separated sizes, e.g., "65536,65536"
 		for (char& ch : res)
 			if (!std::isdigit(ch)) ch = ' ';
 		std::stringstream in(res);
 		for (size_t size; in >> size; net.emplace_back(size));
+		if (net.empty()) // sizes are derived from patterns
+			for (auto& cells : patterns) net.emplace_back(stride[cells.size()]);
 	}
+	/**
+	 * the weight file starts with a header of the tile mapping: { magic, 64 symbols } as uint32,
+	 * followed by the number of tables, then the tables; files without the header are also accepted
+	 */
+	static constexpr uint32_t magic = 0x38343032; // "2048"
+
 	virtual void load_weights(const std::string& path) {
 		std::ifstream in(path, std::ios::in | std::ios::binary);
 		if (!in.is_open()) std::exit(-1);
 		uint32_t size;
 		in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		if (size == magic) {
+			std::array<uint32_t, 64> mapping;
+			in.read(reinterpret_cast<char*>(mapping.data()), sizeof(mapping));
+			if (meta.find("fold") != meta.end() && mapping != fold) {
+				std::cerr << "the tile mapping of " << path << " differs from fold=" << property("fold") << std::endl;
+				std::exit(-1);
+			}
+			fold = mapping;
+			init_stride();
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		}
 		net.resize(size);
 		for (weight& w : net) in >> w;
 		in.close();
 	}
+	virtual void save_profile(const std::string& path) {
+		const std::string idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+		std::vector<std::string> names;
+		for (auto& cells : patterns) {
+			names.emplace_back();
+			for (unsigned cell : cells) names.back() += idx[cell];
+		}
+		std::ofstream out(path, std::ios::out | std::ios::trunc);
+		profile.report(out.is_open() ? out : std::cerr, names);
+	}
 	virtual void save_weights(const std::string& path) {
 		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
 		if (!out.is_open()) std::exit(-1);
+		uint32_t head = magic;
+		out.write(reinterpret_cast<char*>(&head), sizeof(head));
+		out.write(reinterpret_cast<char*>(fold.data()), sizeof(fold));
 		uint32_t size = net.size();
 		out.write(reinterpret_cast<char*>(&size), sizeof(size));
 		for (weight& w : net) out << w;
@@ -113,7 +326,15 @@ protected:
 
 protected:
 	std::vector<weight> net;
+	std::vector<std::vector<unsigned>> patterns;
+	std::array<uint32_t, 64> fold; // the symbol of each tile
+	std::vector<size_t> stride; // radix^k
+	size_t radix;
 	float alpha;
+	std::atomic<uint64_t> version; // the number of updates
+	uint64_t stale;
+	mutable value_cache cache;
+	mutable weight_profile profile;
 };
 
 /**
@@ -124,8 +345,9 @@ protected:
  */
 class random_placer : public random_agent {
 public:
-	random_placer(const std::string& args = "") : random_agent("name=place role=placer " + args),
-		space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), popup(0, 9) {}
+	random_placer(const std::string& args = "") : random_agent("name=place role=placer " + args), popup(0, 9) {
+		for (unsigned pos = 0; pos < space.size(); pos++) space[pos] = pos;
+	}
 
 	virtual action take_action(const board& after) {
 		std::shuffle(space.begin(), space.end(), engine);
@@ -138,7 +360,7 @@ public:
 	}
 
 private:
-	std::array<int, 16> space;
+	std::array<int, board::size> space;
 	std::uniform_int_distribution<int> popup;
 };
 
@@ -163,3 +385,68 @@ public:
 private:
 	std::array<int, 4> opcode;
 };
+
+/**
+ * greedy player with an n-tuple network, i.e., slider
+ * select the action with the largest reward plus afterstate value, see weight_agent
+ * if alpha > 0, learn from the transitions of each episode when it is closed
+ */
+class greedy_slider : public weight_agent {
+public:
+	greedy_slider(const std::string& args = "") : weight_agent("name=slide role=slider " + args) {
+		path.reserve(10000);
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		path.clear();
+	}
+	virtual void close_episode(const std::string& flag = "") {
+		weight_agent::close_episode(flag);
+		if (alpha) learn(path.data(), path.size());
+	}
+
+	virtual action take_action(const board& before) {
+		transition best;
+		int op = select(before, best);
+		if (op == -1) return action();
+		path.push_back(best);
+		return action::slide(op);
+	}
+
+	/**
+	 * take actions for boards of concurrent games, which are not recorded to the path
+	 * since the boards cannot be attributed to games; the finished episodes should be
+	 * replayed and learned instead, as the lockstep loop of 2048.cpp does
+	 */
+	virtual void take_actions(const board* b, action* a, size_t n) {
+		transition best;
+		for (size_t i = 0; i < n; i++) {
+			int op = select(b[i], best);
+			a[i] = (op != -1) ? action::slide(op) : action();
+		}
+	}
+
+	/**
+	 * select the action with the largest reward plus afterstate value, and store its transition
+	 * return the opcode, or -1 if there is no legal action
+	 */
+	int select(const board& before, transition& best) const {
+		float best_value = 0;
+		int best_op = -1;
+		for (int op = 0; op < 4; op++) {
+			board after = before;
+			board::reward reward = after.slide(op);
+			if (reward == -1) continue;
+			float value = reward + estimate(after);
+			if (best_op == -1 || value > best_value) {
+				best = { after, reward };
+				best_value = value;
+				best_op = op;
+			}
+		}
+		return best_op;
+	}
+
+protected:
+	std::vector<transition> path;
+};
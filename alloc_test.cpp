@@ -0,0 +1,76 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * alloc_test.cpp: Check that the game loop does not allocate once warmed up
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+#include "play.h"
+
+/**
+ * the global allocation functions, replaced to count the allocations of the process
+ */
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); } // not paired with new by the optimizer
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+/**
+ * play with the game loop of the program, and count the allocations after a warm-up
+ * return whether no allocation happened after the warm-up
+ */
+bool check(const std::string& name, agent& slide, size_t games) {
+	const size_t warmup = 1000, limit = 100, rounds[] = { 1000, 4000 };
+	statistics stats(warmup + rounds[0] + rounds[1], 0, limit);
+	random_placer place("seed=2");
+	game_loop loop(slide, place, games);
+
+	loop.run(stats, warmup);
+	bool pass = true;
+	for (size_t num : rounds) {
+		size_t before = allocations.load();
+		loop.run(stats, num);
+		size_t count = allocations.load() - before;
+		std::cout << "alloc_test: " << name << ", games=" << games << ": ";
+		std::cout << count << " allocations in " << num << " episodes after warm-up" << std::endl;
+		pass &= (count == 0);
+	}
+	return pass;
+}
+
+int main(int argc, const char* argv[]) {
+	random_slider slide("seed=1");
+	greedy_slider learn("tuple=0123,4567,89AB,CDEF,048C,159D,26AE,37BF init alpha=0.1 seed=1");
+	bool pass = true;
+	for (size_t games : { 1, 64 }) {
+		pass &= check("random slider", slide, games);
+		pass &= check("tuple network", learn, games);
+	}
+	std::cout << "alloc_test: " << (pass ? "passed" : "FAILED") << std::endl;
+	return pass ? 0 : 1;
+}
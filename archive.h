@@ -0,0 +1,215 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * archive.h: Indexed archive of saved episodes with random access and filtered queries
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+#include <functional>
+#include <sys/stat.h>
+#include "board.h"
+#include "episode.h"
+#include "statistics.h"
+
+/**
+ * an archive is a saved record file (one episode per line) with a sidecar index (path + ".idx")
+ * the index stores the position and the brief record of each episode, so that queries
+ * can be answered from the index, and only the matching episodes are decoded
+ *
+ * index format: "2048idx2", uint64 size and int64 mtime (in ns) of the record file,
+ * uint64 count, then 'count' fixed-size entries; the index is rebuilt if the size or
+ * the mtime does not match, e.g., after the record file is overwritten by another run
+ */
+class archive {
+public:
+	struct entry : statistics::record {
+		uint64_t offset; // byte offset of the line in the record file
+		uint64_t length; // byte length of the line, excluding the newline
+		entry(const statistics::record& rec = {}, uint64_t offset = 0, uint64_t length = 0)
+			: statistics::record(rec), offset(offset), length(length) {}
+	};
+	static_assert(sizeof(entry) == 64, "unexpected layout of archive entries");
+
+public:
+	archive(const std::string& path) : path(path), file(path) {
+		if (!file.is_open()) throw std::runtime_error("cannot open " + path);
+		if (!load_index()) build_index();
+	}
+	archive(const archive&) = delete;
+	archive& operator =(const archive&) = delete;
+
+public:
+	size_t count() const { return index.size(); }
+	const entry& at(size_t i) const { return index.at(i); }
+
+	/**
+	 * decode the episode of an entry, seeking directly to its line
+	 */
+	episode fetch(const entry& e) const {
+		episode ep;
+		if (e.offset + e.length <= file.size()) ep.decode(file.begin() + e.offset, file.begin() + e.offset + e.length);
+		ep.shrink_to_fit();
+		return ep;
+	}
+
+	/**
+	 * select the ids (0-based line numbers) of entries matching a filter,
+	 * which is a space-separated list of conditions, all of which should hold
+	 * a condition is "key op value", where
+	 *  key: id, score, max (the largest tile, e.g., max<2048), step, time (duration in ms)
+	 *  op: <, <=, >, >=, =, !=
+	 */
+	std::vector<size_t> select(const std::string& filter) const {
+		std::vector<std::function<bool(size_t)>> conds;
+		std::stringstream ss(filter);
+		for (std::string cond; ss >> cond; ) {
+			size_t p = cond.find_first_of("<>=!");
+			size_t q = cond.find_first_not_of("<>=!", p);
+			if (p == 0 || p == std::string::npos || q == std::string::npos)
+				throw std::invalid_argument("invalid condition: " + cond);
+			std::string key = cond.substr(0, p), op = cond.substr(p, q - p);
+			size_t end = 0;
+			int64_t value = 0;
+			try { value = std::stoll(cond.substr(q), &end); } catch (std::exception&) {}
+			if (end == 0 || q + end != cond.size())
+				throw std::invalid_argument("invalid condition: " + cond);
+			std::function<int64_t(size_t)> field;
+			if (key == "id") {
+				field = [](size_t i) { return int64_t(i); };
+			} else if (key == "score") {
+				field = [this](size_t i) { return int64_t(index[i].score); };
+			} else if (key == "max") {
+				field = [this](size_t i) { return int64_t((1 << index[i].tile) & -2u); };
+			} else if (key == "step") {
+				field = [this](size_t i) { return int64_t(index[i].step[0]); };
+			} else if (key == "time") {
+				field = [this](size_t i) { return int64_t(index[i].time[0]); };
+			} else {
+				throw std::invalid_argument("invalid condition: " + cond);
+			}
+			if (op == "<") {
+				conds.emplace_back([=](size_t i) { return field(i) < value; });
+			} else if (op == "<=") {
+				conds.emplace_back([=](size_t i) { return field(i) <= value; });
+			} else if (op == ">") {
+				conds.emplace_back([=](size_t i) { return field(i) > value; });
+			} else if (op == ">=") {
+				conds.emplace_back([=](size_t i) { return field(i) >= value; });
+			} else if (op == "=" || op == "==") {
+				conds.emplace_back([=](size_t i) { return field(i) == value; });
+			} else if (op == "!=") {
+				conds.emplace_back([=](size_t i) { return field(i) != value; });
+			} else {
+				throw std::invalid_argument("invalid condition: " + cond);
+			}
+		}
+
+		std::vector<size_t> res;
+		for (size_t i = 0; i < index.size(); i++) {
+			if (std::all_of(conds.begin(), conds.end(), [=](const std::function<bool(size_t)>& c) { return c(i); }))
+				res.push_back(i);
+		}
+		return res;
+	}
+
+	/**
+	 * show the statistics of the selected entries from the index only, in the format of statistics::show
+	 */
+	void show(const std::vector<size_t>& ids, bool tstat = true) const {
+		statistics::report rpt;
+		for (size_t i : ids) rpt += index[i];
+		if (rpt.num) rpt.show(rpt.num, tstat);
+	}
+
+public:
+	/**
+	 * save the records of statistics to a file, together with its index
+	 */
+	static void save(const statistics& stat, const std::string& path) {
+		std::ofstream out(path, std::ios::out | std::ios::trunc);
+		std::vector<entry> index;
+		index.reserve(stat.size());
+		for (size_t i = 0; i < stat.size(); i++) {
+			uint64_t offset = out.tellp();
+			out << stat.at(i);
+			index.emplace_back(stat.at(i), offset, uint64_t(out.tellp()) - offset);
+			out << std::endl;
+		}
+		out.close();
+		save_index(path, index);
+	}
+
+protected:
+	static std::string index_path(const std::string& path) { return path + ".idx"; }
+	static constexpr const char* magic() { return "2048idx2"; }
+
+	/**
+	 * save the index of a record file, stamped with the current size and mtime of the file
+	 */
+	static void save_index(const std::string& path, const std::vector<entry>& index) {
+		struct stat st;
+		if (::stat(path.c_str(), &st) != 0) return;
+		std::ofstream out(index_path(path), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return;
+		uint64_t size = st.st_size, num = index.size();
+		int64_t mtime = record_file::modified(st);
+		out.write(magic(), 8);
+		out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		out.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+		out.write(reinterpret_cast<const char*>(&num), sizeof(num));
+		out.write(reinterpret_cast<const char*>(index.data()), sizeof(entry) * num);
+		out.close();
+	}
+
+	/**
+	 * load the index, which is rejected if it is missing or its stamp does not match the record file
+	 */
+	bool load_index() {
+		std::ifstream in(index_path(path), std::ios::in | std::ios::binary);
+		if (!in.is_open()) return false;
+		char sig[8] = {};
+		uint64_t stamp = 0, num = 0;
+		int64_t when = 0;
+		in.read(sig, 8);
+		in.read(reinterpret_cast<char*>(&stamp), sizeof(stamp));
+		in.read(reinterpret_cast<char*>(&when), sizeof(when));
+		in.read(reinterpret_cast<char*>(&num), sizeof(num));
+		if (!in || !std::equal(sig, sig + 8, magic())) return false;
+		if (stamp != file.size() || when != file.mtime()) return false;
+		index.resize(num);
+		in.read(reinterpret_cast<char*>(index.data()), sizeof(entry) * num);
+		if (!in || (num && index.back().offset + index.back().length > file.size())) {
+			index.clear();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * rebuild the index by scanning the record file, e.g., for records saved without an index
+	 */
+	void build_index() {
+		index.clear();
+		episode ep;
+		for (const char* it = file.begin(); it < file.end(); ) {
+			const char* eol = std::find(it, file.end(), '\n');
+			ep.decode(it, eol);
+			index.emplace_back(ep, it - file.begin(), eol - it);
+			it = eol + 1;
+		}
+		save_index(path, index);
+	}
+
+private:
+	std::string path;
+	record_file file;
+	std::vector<entry> index;
+};
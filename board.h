@@ -13,54 +13,74 @@
 #include <iomanip>
 #include <algorithm>
 #include <cmath>
+#include <string>
+#include <cstdint>
 
 /**
- * array-based board for 2048
+ * array-based board for 2048 & 2048-like games
+ * the geometry (ROW x COL) is fixed at compile time
  *
- * index (1-d form):
+ * index (1-d form), e.g., 4x4:
  *  (0)  (1)  (2)  (3)
  *  (4)  (5)  (6)  (7)
  *  (8)  (9) (10) (11)
  * (12) (13) (14) (15)
  *
  */
-class board {
+template<unsigned ROW, unsigned COL>
+class basic_board {
 public:
 	typedef uint32_t cell;
-	typedef std::array<cell, 4> row;
-	typedef std::array<row, 4> grid;
+	typedef std::array<cell, COL> row;
+	typedef std::array<row, ROW> grid;
 	typedef uint64_t data;
 	typedef uint64_t score;
 	typedef int reward;
 
+	static constexpr unsigned rows = ROW;
+	static constexpr unsigned cols = COL;
+	static constexpr unsigned size = ROW * COL;
+	static_assert(ROW >= 2 && COL >= 2 && size <= 36, "unsupported board geometry");
+
 public:
-	board() : tile(), attr(0) {}
-	board(const grid& b, data v = 0) : tile(b), attr(v) {}
-	board(const board& b) = default;
-	board& operator =(const board& b) = default;
+	basic_board() : tile(), attr(0) {}
+	basic_board(const grid& b, data v = 0) : tile(b), attr(v) {}
+	basic_board(const basic_board& b) = default;
+	basic_board& operator =(const basic_board& b) = default;
 
 	operator grid&() { return tile; }
 	operator const grid&() const { return tile; }
 	row& operator [](unsigned i) { return tile[i]; }
 	const row& operator [](unsigned i) const { return tile[i]; }
-	cell& operator ()(unsigned i) { return tile[i / 4][i % 4]; }
-	const cell& operator ()(unsigned i) const { return tile[i / 4][i % 4]; }
+	cell& operator ()(unsigned i) { return tile[i / COL][i % COL]; }
+	const cell& operator ()(unsigned i) const { return tile[i / COL][i % COL]; }
 
 	cell* begin() { return &(operator()(0)); }
 	const cell* begin() const { return &(operator()(0)); }
-	cell* end() { return begin() + 16; }
-	const cell* end() const { return begin() + 16; }
+	cell* end() { return begin() + size; }
+	const cell* end() const { return begin() + size; }
 
 	data info() const { return attr; }
 	data info(data dat) { data old = attr; attr = dat; return old; }
 
+	/**
+	 * 64-bit hash of the tiles (the attribute is not included)
+	 */
+	uint64_t hash() const {
+		uint64_t h = 0;
+		for (cell t : *this) h = (h ^ t) * 0x100000001b3ull + 0x9e3779b97f4a7c15ull;
+		h ^= h >> 30, h *= 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 27, h *= 0x94d049bb133111ebull;
+		return h ^ (h >> 31);
+	}
+
 public:
-	bool operator ==(const board& b) const { return tile == b.tile; }
-	bool operator < (const board& b) const { return tile <  b.tile; }
-	bool operator !=(const board& b) const { return !(*this == b); }
-	bool operator > (const board& b) const { return b < *this; }
-	bool operator <=(const board& b) const { return !(b < *this); }
-	bool operator >=(const board& b) const { return !(*this < b); }
+	bool operator ==(const basic_board& b) const { return tile == b.tile; }
+	bool operator < (const basic_board& b) const { return tile <  b.tile; }
+	bool operator !=(const basic_board& b) const { return !(*this == b); }
+	bool operator > (const basic_board& b) const { return b < *this; }
+	bool operator <=(const basic_board& b) const { return !(b < *this); }
+	bool operator >=(const basic_board& b) const { return !(*this < b); }
 
 public:
 
@@ -69,7 +89,7 @@ public:
 	 * return 0 if the action is valid, or -1 if not
 	 */
 	reward place(unsigned pos, cell tile) {
-		if (pos >= 16 || operator()(pos)) return -1;
+		if (pos >= size || operator()(pos)) return -1;
 		if (tile != 1 && tile != 2) return -1;
 		operator()(pos) = tile;
 		return 0;
@@ -89,51 +109,10 @@ public:
 		}
 	}
 
-	reward slide_left() {
-		board prev = *this;
-		reward score = 0;
-		for (int r = 0; r < 4; r++) {
-			auto& row = tile[r];
-			int top = 0, hold = 0;
-			for (int c = 0; c < 4; c++) {
-				int tile = row[c];
-				if (tile == 0) continue;
-				row[c] = 0;
-				if (hold) {
-					if (tile == hold) {
-						row[top++] = ++tile;
-						score += (1 << tile);
-						hold = 0;
-					} else {
-						row[top++] = hold;
-						hold = tile;
-					}
-				} else {
-					hold = tile;
-				}
-			}
-			if (hold) tile[r][top] = hold;
-		}
-		return (*this != prev) ? score : -1;
-	}
-	reward slide_right() {
-		reflect_horizontal();
-		reward score = slide_left();
-		reflect_horizontal();
-		return score;
-	}
-	reward slide_up() {
-		rotate_clockwise();
-		reward score = slide_right();
-		rotate_counterclockwise();
-		return score;
-	}
-	reward slide_down() {
-		rotate_clockwise();
-		reward score = slide_left();
-		rotate_counterclockwise();
-		return score;
-	}
+	reward slide_left()  { return slide_lines<ROW, COL, 0, COL, 1>(); }
+	reward slide_right() { return slide_lines<ROW, COL, COL - 1, COL, -1>(); }
+	reward slide_up()    { return slide_lines<COL, ROW, 0, 1, COL>(); }
+	reward slide_down()  { return slide_lines<COL, ROW, (ROW - 1) * COL, 1, -int(COL)>(); }
 
 	void rotate(int clockwise_count = 1) {
 		switch (((clockwise_count % 4) + 4) % 4) {
@@ -150,40 +129,143 @@ public:
 	void reverse() { reflect_horizontal(); reflect_vertical(); }
 
 	void reflect_horizontal() {
-		for (int r = 0; r < 4; r++) {
-			std::swap(tile[r][0], tile[r][3]);
-			std::swap(tile[r][1], tile[r][2]);
+		for (unsigned r = 0; r < ROW; r++) {
+			std::reverse(tile[r].begin(), tile[r].end());
 		}
 	}
 
 	void reflect_vertical() {
-		for (int c = 0; c < 4; c++) {
-			std::swap(tile[0][c], tile[3][c]);
-			std::swap(tile[1][c], tile[2][c]);
-		}
+		std::reverse(tile.begin(), tile.end());
 	}
 
+	/**
+	 * note that transpose (and thus rotation) is only available for square boards
+	 */
 	void transpose() {
-		for (int r = 0; r < 4; r++) {
-			for (int c = r + 1; c < 4; c++) {
+		static_assert(ROW == COL, "transpose requires a square board");
+		for (unsigned r = 0; r < ROW; r++) {
+			for (unsigned c = r + 1; c < COL; c++) {
 				std::swap(tile[r][c], tile[c][r]);
 			}
 		}
 	}
 
+protected:
+	/**
+	 * slide 'num' lines of 'len' cells toward their heads, where
+	 * cell k of line l is located at (1-d index) head + l * next + k * step
+	 *
+	 * all of the geometry is known at compile time, so each direction
+	 * gets its own unrolled kernel without rotating the board
+	 * return the reward of the action, or -1 if nothing moved
+	 */
+	template<unsigned num, unsigned len, unsigned head, unsigned next, int step>
+	reward slide_lines() {
+		reward score = 0;
+		bool moved = false;
+		for (unsigned l = 0; l < num; l++) {
+			cell* line = begin() + head + l * next;
+			reward gain = line_table<len>::fits(line, step) ?
+				line_table<len>::slide(line, step) : slide_line<len>(line, step);
+			moved |= (gain != -1);
+			score += std::max(gain, 0);
+		}
+		return moved ? score : -1;
+	}
+
+	/**
+	 * slide a single line of 'len' cells toward its head
+	 * return the reward of the line, or -1 if nothing moved
+	 */
+	template<unsigned len>
+	static reward slide_line(cell* line, int step) {
+		reward score = 0;
+		bool moved = false;
+		unsigned top = 0, from = 0;
+		cell hold = 0;
+		for (unsigned k = 0; k < len; k++) {
+			cell tile = line[int(k) * step];
+			if (tile == 0) continue;
+			line[int(k) * step] = 0;
+			if (tile == hold) {
+				line[int(top++) * step] = ++tile;
+				score += (1 << tile);
+				hold = 0;
+				moved = true;
+			} else {
+				if (hold) {
+					line[int(top) * step] = hold;
+					moved |= (top++ != from);
+				}
+				hold = tile;
+				from = k;
+			}
+		}
+		if (hold) {
+			line[int(top) * step] = hold;
+			moved |= (top != from);
+		}
+		return moved ? score : -1;
+	}
+
+	/**
+	 * precomputed results of sliding a line whose tiles are all below 16
+	 * a line is indexed by its tiles, 4 bits per cell, head at the lowest bits
+	 * the table is only used for lines up to 4 cells (64K entries)
+	 */
+	template<unsigned len, bool enable = (len <= 4)>
+	struct line_table {
+		struct entry {
+			std::array<uint8_t, len> line;
+			reward score;
+		};
+		static bool fits(const cell* line, int step) {
+			cell any = 0;
+			for (unsigned k = 0; k < len; k++) any |= line[int(k) * step];
+			return any < 16;
+		}
+		static reward slide(cell* line, int step) {
+			unsigned index = 0;
+			for (unsigned k = 0; k < len; k++) index |= line[int(k) * step] << (4 * k);
+			const entry& e = entries()[index];
+			for (unsigned k = 0; k < len; k++) line[int(k) * step] = e.line[k];
+			return e.score;
+		}
+		static const entry* entries() {
+			static const table_type table;
+			return table.data();
+		}
+		struct table_type : std::array<entry, (1u << (4 * len))> {
+			table_type() {
+				for (unsigned index = 0; index < this->size(); index++) {
+					std::array<cell, len> line;
+					for (unsigned k = 0; k < len; k++) line[k] = (index >> (4 * k)) & 0x0f;
+					(*this)[index].score = slide_line<len>(line.data(), 1);
+					std::copy(line.begin(), line.end(), (*this)[index].line.begin());
+				}
+			}
+		};
+	};
+	template<unsigned len>
+	struct line_table<len, false> {
+		static bool fits(const cell* line, int step) { return false; }
+		static reward slide(cell* line, int step) { return -1; }
+	};
+
 public:
-	friend std::ostream& operator <<(std::ostream& out, const board& b) {
-		out << "+------------------------+" << std::endl;
+	friend std::ostream& operator <<(std::ostream& out, const basic_board& b) {
+		const std::string border = "+" + std::string(6 * COL, '-') + "+";
+		out << border << std::endl;
 		for (auto& row : b.tile) {
 			out << "|" << std::dec;
 			for (auto t : row) out << std::setw(6) << ((1 << t) & -2u);
 			out << "|" << std::endl;
 		}
-		out << "+------------------------+" << std::endl;
+		out << border << std::endl;
 		return out;
 	}
-	friend std::istream& operator >>(std::istream& in, board& b) {
-		for (int i = 0; i < 16; i++) {
+	friend std::istream& operator >>(std::istream& in, basic_board& b) {
+		for (unsigned i = 0; i < size; i++) {
 			while (!std::isdigit(in.peek()) && in.good()) in.ignore(1);
 			in >> b(i);
 			b(i) = std::log2(b(i));
@@ -195,3 +277,16 @@ private:
 	grid tile;
 	data attr;
 };
+
+/**
+ * the board geometry used by the framework, 4x4 by default
+ * other geometries can be selected at compile time, e.g.,
+ * make FLAGS="-DBOARD_ROWS=3 -DBOARD_COLS=3"
+ */
+#ifndef BOARD_ROWS
+#define BOARD_ROWS 4
+#endif
+#ifndef BOARD_COLS
+#define BOARD_COLS BOARD_ROWS
+#endif
+typedef basic_board<BOARD_ROWS, BOARD_COLS> board;
@@ -0,0 +1,90 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * cache.h: Afterstate value cache for weight agents
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include "board.h"
+
+/**
+ * bounded, lossy, lock-free cache of afterstate values
+ *
+ * the cache is direct-mapped by board::hash, and a newer value simply replaces the older one;
+ * each entry stores the value with the weight epoch it was computed at, so that all entries
+ * become stale once the weights are updated, without clearing the table
+ *
+ * concurrent readers and writers are allowed: an entry keeps 'tag = key ^ data' instead of the key,
+ * so that a torn entry (tag and data from different writers) fails the check and counts as a miss
+ */
+class value_cache {
+public:
+	value_cache(size_t size = 0) : table(size ? floor2(size) : 0), mask(table.size() - 1) {}
+	value_cache(const value_cache&) = delete;
+	value_cache& operator =(const value_cache&) = delete;
+
+	size_t size() const { return table.size(); }
+
+	/**
+	 * find the value of an afterstate computed at 'epoch', return false if missed
+	 */
+	bool find(const board& after, uint32_t epoch, float& value) {
+		if (table.empty()) return false;
+		uint64_t key = after.hash();
+		const entry& e = table[key & mask];
+		uint64_t data = e.data.load(std::memory_order_relaxed);
+		uint64_t tag = e.tag.load(std::memory_order_relaxed);
+		if ((tag ^ data) != key || uint32_t(data >> 32) != epoch) {
+			misses().fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		uint32_t bits = data;
+		std::memcpy(&value, &bits, sizeof(value));
+		hits().fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	 * store the value of an afterstate computed at 'epoch'
+	 */
+	void store(const board& after, uint32_t epoch, float value) {
+		if (table.empty()) return;
+		uint64_t key = after.hash();
+		entry& e = table[key & mask];
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		uint64_t data = uint64_t(epoch) << 32 | bits;
+		e.data.store(data, std::memory_order_relaxed);
+		e.tag.store(key ^ data, std::memory_order_relaxed);
+	}
+
+	/**
+	 * the number of hits and misses of all caches of the process
+	 */
+	static std::atomic<uint64_t>& hits() { static std::atomic<uint64_t> n(0); return n; }
+	static std::atomic<uint64_t>& misses() { static std::atomic<uint64_t> n(0); return n; }
+
+protected:
+	struct entry {
+		std::atomic<uint64_t> tag;
+		std::atomic<uint64_t> data;
+		entry() : tag(0), data(0) {}
+	};
+
+	static size_t floor2(size_t n) {
+		size_t p = 1;
+		while (p <= n / 2) p <<= 1;
+		return p;
+	}
+
+private:
+	std::vector<entry> table;
+	size_t mask;
+};
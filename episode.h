@@ -29,15 +29,40 @@ public:
 	board::score score() const { return ep_score; }
 
 	void open_episode(const std::string& tag) {
-		ep_open = { tag, millisec() };
+		ep_open.assign(tag, millisec());
 	}
 	void close_episode(const std::string& tag) {
-		ep_close = { tag, millisec() };
+		ep_close.assign(tag, millisec());
+	}
+	/**
+	 * close an episode which took 'time' milliseconds since it was opened,
+	 * e.g., the share of an episode played in lockstep with others
+	 */
+	void close_episode(const std::string& tag, time_t time) {
+		ep_close.assign(tag, ep_open.when + time);
+	}
+
+	/**
+	 * reset to the initial state, keeping the allocated storage for reuse
+	 */
+	void reset() {
+		ep_state = initial_state();
+		ep_score = 0;
+		ep_moves.clear();
+		ep_time = 0;
+		ep_open.assign("N/A", 0);
+		ep_close.assign("N/A", 0);
 	}
 	bool apply_action(action move) {
+		return apply_action(move, millisec() - ep_time);
+	}
+	/**
+	 * apply an action which took 'time' milliseconds, e.g., a share of the time of a batch
+	 */
+	bool apply_action(action move, time_t time) {
 		board::reward reward = move.apply(state());
 		if (reward == -1) return false;
-		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		ep_moves.emplace_back(move, reward, time);
 		ep_score += reward;
 		return true;
 	}
@@ -76,6 +101,19 @@ public:
 		return time;
 	}
 
+	/**
+	 * replay the actions from the initial state, and call f(afterstate, reward) after each slide
+	 */
+	template<typename visitor>
+	void replay(visitor f) const {
+		board state = initial_state();
+		for (const move& mv : ep_moves) {
+			action code = mv;
+			board::reward reward = code.apply(state);
+			if (code.type() == action::slide::type && reward != -1) f(state, reward);
+		}
+	}
+
 	std::vector<action> actions(unsigned who = -1u) const {
 		std::vector<action> res;
 		size_t i = 2;
@@ -102,7 +140,7 @@ public:
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, episode& ep) {
-		ep = {};
+		ep.reset();
 		std::string token;
 		std::getline(in, token, '|');
 		std::stringstream(token) >> ep.ep_open;
@@ -117,6 +155,31 @@ public:
 		return in;
 	}
 
+	/**
+	 * decode an episode from a line of text [begin, end) in the same format as operator >>
+	 * this uses a hand-written tokenizer instead of streams, for loading large records
+	 * the storage is reused, so an episode can decode many lines without allocating
+	 */
+	void decode(const char* begin, const char* end) {
+		reset();
+		const char* open = std::find(begin, end, '|');
+		const char* close = std::find(std::min(open + 1, end), end, '|');
+		ep_open.decode(begin, open);
+		for (const char* it = std::min(open + 1, end); it < close; ) {
+			ep_moves.emplace_back();
+			it = ep_moves.back().decode(it, close);
+			ep_score += action(ep_moves.back()).apply(ep_state);
+		}
+		ep_close.decode(std::min(close + 1, end), end);
+	}
+
+	/**
+	 * release the unused storage, e.g., before keeping a decoded episode
+	 */
+	void shrink_to_fit() {
+		ep_moves.shrink_to_fit();
+	}
+
 protected:
 
 	struct move {
@@ -148,12 +211,21 @@ protected:
 			}
 			return in;
 		}
+		const char* decode(const char* in, const char* end) {
+			in = code.decode(in, end);
+			reward = 0;
+			time = 0;
+			if (in < end && *in == '[') in = decode_number(in + 1, end, reward) + 1;
+			if (in < end && *in == '(') in = decode_number(in + 1, end, time) + 1;
+			return std::min(in, end);
+		}
 	};
 
 	struct meta {
 		std::string tag;
 		time_t when;
 		meta(const std::string& tag = "N/A", time_t when = 0) : tag(tag), when(when) {}
+		void assign(const std::string& t, time_t w) { tag.assign(t); when = w; }
 
 		friend std::ostream& operator <<(std::ostream& out, const meta& m) {
 			return out << m.tag << "@" << std::dec << m.when;
@@ -161,11 +233,31 @@ protected:
 		friend std::istream& operator >>(std::istream& in, meta& m) {
 			return std::getline(in, m.tag, '@') >> std::dec >> m.when;
 		}
+		void decode(const char* begin, const char* end) {
+			const char* at = std::find(begin, end, '@');
+			tag.assign(begin, at);
+			when = 0;
+			if (at < end) decode_number(at + 1, end, when);
+		}
 	};
 
+	/**
+	 * decode a decimal number from [in, end), and return the position after it
+	 */
+	template<typename numeric>
+	static const char* decode_number(const char* in, const char* end, numeric& v) {
+		bool neg = (in < end && *in == '-');
+		v = 0;
+		for (in += neg; in < end && std::isdigit(*in); in++) v = v * 10 + (*in - '0');
+		if (neg) v = -v;
+		return in;
+	}
+
 	static board initial_state() {
 		return {};
 	}
+
+public:
 	static time_t millisec() {
 		auto now = std::chrono::system_clock::now().time_since_epoch();
 		return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
@@ -0,0 +1,309 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * external.h: Adapter for agents running as external processes
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+/**
+ * agent adapter for an external program, which is spawned as a child process
+ * and talks through its stdin/stdout, using either pipes or a Unix socket pair
+ *
+ * boards from concurrent games are batched per request, and several requests
+ * are kept in flight, so that the latency of a round trip is amortized;
+ * the requests are written without blocking while the responses are drained,
+ * so the channel never deadlocks however large the requests in flight are
+ *
+ * protocol (binary, host byte order), where each frame starts with a header of
+ * two uint32, 'seq' and 'count':
+ *  handshake: the adapter sends { magic, rows << 16 | cols }, the program echoes it
+ *  request:   { seq, count }, then 'count' boards, each as board::size bytes of cells
+ *  response:  { seq, count }, then 'count' uint32 action codes
+ * the program should exit when its stdin is closed
+ *
+ * options:
+ *  exec=PROG,ARG,...: the command line of the program (comma-separated)
+ *  channel=pipe|socket: the channel connected to the stdin/stdout of the program
+ *  batch=N: the maximum number of boards per request, 64 by default
+ *  depth=N: the maximum number of requests in flight, 4 by default
+ */
+class external_agent : public agent {
+public:
+	static constexpr uint32_t magic = 0x38343032; // "2048"
+
+	struct header {
+		uint32_t seq;
+		uint32_t count;
+	};
+
+public:
+	external_agent(const std::string& args = "") : agent("name=external role=slider batch=64 depth=4 " + args),
+		batch(std::max(int(meta["batch"]), 1)), depth(std::max(int(meta["depth"]), 1)),
+		child(-1), in(-1), out(-1), seq(0), calls(0), boards(0), latency(0), longest(0), busy(0) {
+		spawn(property("exec"), meta.find("channel") != meta.end() && property("channel") == "socket");
+		header hello = { magic, board::rows << 16 | board::cols };
+		send(&hello, sizeof(hello));
+		if (!recv(&hello, sizeof(hello)) || hello.seq != magic || hello.count != (board::rows << 16 | board::cols))
+			throw std::runtime_error("external agent handshake failed: " + property("exec"));
+	}
+	virtual ~external_agent() {
+		if (out != -1) ::close(out);
+		if (in != -1 && in != out) ::close(in);
+		if (child != -1) ::waitpid(child, nullptr, 0);
+		if (calls) report(std::cerr);
+	}
+
+	virtual action take_action(const board& b) {
+		action a;
+		take_actions(&b, &a, 1);
+		return a;
+	}
+
+	/**
+	 * split the boards into requests of at most 'batch' boards, and keep at most 'depth' requests in flight
+	 * the encoded requests wait in the outbox, which is written whenever the channel accepts more,
+	 * while the responses are read into the inbox and consumed in order once complete
+	 */
+	virtual void take_actions(const board* b, action* a, size_t n) {
+		auto start = clock::now();
+		std::deque<pending> flight;
+		outbox.clear();
+		inbox.clear();
+		for (size_t i = 0; i < n || flight.size(); ) {
+			while (i < n && flight.size() < depth) {
+				size_t num = std::min(n - i, batch);
+				flight.push_back({ seq++, a + i, num, clock::now() });
+				request(flight.back().seq, b + i, num);
+				i += num;
+			}
+			pollfd fds[2] = { { in, POLLIN, 0 }, { out, short(outbox.size() ? POLLOUT : 0), 0 } };
+			if (::poll(fds, 2, -1) == -1) {
+				if (errno == EINTR) continue;
+				throw std::runtime_error("external agent poll failed: " + property("exec"));
+			}
+			if (fds[1].revents) {
+				ssize_t num = ::write(out, outbox.data(), outbox.size());
+				if (num == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					throw std::runtime_error("external agent is gone: " + property("exec"));
+				if (num > 0) outbox.erase(outbox.begin(), outbox.begin() + num);
+			}
+			if (fds[0].revents) {
+				size_t size = inbox.size();
+				inbox.resize(size + 65536);
+				ssize_t num = ::read(in, inbox.data() + size, 65536);
+				if (num == 0 || (num == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+					throw std::runtime_error("external agent is gone: " + property("exec"));
+				inbox.resize(size + std::max<ssize_t>(num, 0));
+				size_t used = 0;
+				while (flight.size() && inbox.size() - used >= sizeof(header) + flight.front().count * sizeof(uint32_t)) {
+					used += response(flight.front(), inbox.data() + used);
+					flight.pop_front();
+				}
+				inbox.erase(inbox.begin(), inbox.begin() + used);
+			}
+		}
+		busy += std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+	}
+
+	/**
+	 * report the number of calls, the per-call latency, and the throughput
+	 */
+	void report(std::ostream& out) const {
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(1);
+		out << name() << ": " << calls << " calls, " << boards << " boards, ";
+		out << "latency = " << (latency * 1.0 / calls) << "us (max " << longest << "us), ";
+		out << "throughput = " << (boards * 1000000.0 / std::max(busy, 1ll)) << " boards/s" << std::endl;
+		out.copyfmt(ff);
+	}
+
+public:
+	/**
+	 * serve the protocol with an in-process agent, i.e., the program side of the adapter
+	 * return when the input is closed, or the handshake does not match the board geometry
+	 */
+	static void serve(agent& who, int in = 0, int out = 1) {
+		header hdr;
+		if (!read_all(in, &hdr, sizeof(hdr))) return;
+		if (hdr.seq != magic || hdr.count != (board::rows << 16 | board::cols)) return;
+		write_all(out, &hdr, sizeof(hdr));
+		std::vector<uint8_t> cells;
+		std::vector<uint32_t> codes;
+		while (read_all(in, &hdr, sizeof(hdr))) {
+			cells.resize(hdr.count * board::size);
+			codes.resize(hdr.count + 2);
+			if (!read_all(in, cells.data(), cells.size())) return;
+			codes[0] = hdr.seq;
+			codes[1] = hdr.count;
+			for (size_t k = 0; k < hdr.count; k++) {
+				board b;
+				std::copy(cells.begin() + k * board::size, cells.begin() + (k + 1) * board::size, b.begin());
+				codes[k + 2] = who.take_action(b);
+			}
+			if (!write_all(out, codes.data(), codes.size() * sizeof(uint32_t))) return;
+		}
+	}
+
+protected:
+	typedef std::chrono::steady_clock clock;
+
+	struct pending {
+		uint32_t seq;
+		action* result;
+		size_t count;
+		clock::time_point since;
+	};
+
+	/**
+	 * append a request to the outbox
+	 */
+	void request(uint32_t seq, const board* b, size_t n) {
+		size_t base = outbox.size();
+		outbox.resize(base + sizeof(header) + n * board::size);
+		header hdr = { seq, uint32_t(n) };
+		std::copy_n(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr), outbox.begin() + base);
+		for (size_t k = 0; k < n; k++)
+			std::copy(b[k].begin(), b[k].end(), outbox.begin() + base + sizeof(hdr) + k * board::size);
+	}
+
+	/**
+	 * consume the complete response of a request from 'frame', and return its size in bytes
+	 */
+	size_t response(const pending& req, const uint8_t* frame) {
+		header hdr;
+		std::copy_n(frame, sizeof(hdr), reinterpret_cast<uint8_t*>(&hdr));
+		if (hdr.seq != req.seq || hdr.count != req.count)
+			throw std::runtime_error("external agent protocol error: " + property("exec"));
+		const uint8_t* codes = frame + sizeof(hdr);
+		for (size_t k = 0; k < req.count; k++) {
+			uint32_t code;
+			std::copy_n(codes + k * sizeof(code), sizeof(code), reinterpret_cast<uint8_t*>(&code));
+			req.result[k] = code;
+		}
+		long long usec = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - req.since).count();
+		calls++;
+		boards += req.count;
+		latency += usec;
+		longest = std::max(longest, usec);
+		return sizeof(hdr) + req.count * sizeof(uint32_t);
+	}
+
+	void send(const void* data, size_t size) {
+		if (!write_all(out, data, size)) throw std::runtime_error("external agent is gone: " + property("exec"));
+	}
+	bool recv(void* data, size_t size) {
+		return read_all(in, data, size);
+	}
+
+	/**
+	 * write or read exactly 'size' bytes, waiting for the descriptor if it is non-blocking
+	 */
+	static bool write_all(int fd, const void* data, size_t size) {
+		for (const char* it = static_cast<const char*>(data); size; ) {
+			ssize_t n = ::write(fd, it, size);
+			if (n == -1 && wait(fd, POLLOUT)) continue;
+			if (n <= 0) return false;
+			it += n, size -= n;
+		}
+		return true;
+	}
+	static bool read_all(int fd, void* data, size_t size) {
+		for (char* it = static_cast<char*>(data); size; ) {
+			ssize_t n = ::read(fd, it, size);
+			if (n == -1 && wait(fd, POLLIN)) continue;
+			if (n <= 0) return false;
+			it += n, size -= n;
+		}
+		return true;
+	}
+	static bool wait(int fd, short events) {
+		if (errno == EINTR) return true;
+		if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+		pollfd p = { fd, events, 0 };
+		return ::poll(&p, 1, -1) != -1 || errno == EINTR;
+	}
+
+	/**
+	 * spawn the program with its stdin/stdout connected to this process
+	 */
+	void spawn(const std::string& exec, bool socket) {
+		std::vector<std::string> argv;
+		std::stringstream ss(exec);
+		for (std::string arg; std::getline(ss, arg, ','); ) argv.push_back(arg);
+		if (argv.empty()) throw std::invalid_argument("external agent requires exec=PROG,ARG,...");
+		std::vector<char*> args;
+		for (std::string& arg : argv) args.push_back(&arg[0]);
+		args.push_back(nullptr);
+
+		int down[2], up[2]; // parent-to-child and child-to-parent
+		if (socket) {
+			if (::socketpair(AF_UNIX, SOCK_STREAM, 0, down) != 0) throw std::runtime_error("socketpair failed");
+			up[0] = down[0], up[1] = down[1];
+		} else if (::pipe(down) != 0 || ::pipe(up) != 0) {
+			throw std::runtime_error("pipe failed");
+		}
+		std::signal(SIGPIPE, SIG_IGN);
+		child = ::fork();
+		if (child == 0) {
+			// with a socket pair, down[1] is the end of the child, and down[0] is the end of the parent
+			int cin = socket ? down[1] : down[0], cout = up[1];
+			::dup2(cin, 0);
+			::dup2(cout, 1);
+			for (int fd : { down[0], down[1], up[0], up[1] }) if (fd > 1) ::close(fd);
+			::execvp(args[0], args.data());
+			::_exit(127);
+		}
+		if (socket) {
+			::close(down[1]);
+			in = out = down[0];
+		} else {
+			::close(down[0]);
+			::close(up[1]);
+			in = up[0];
+			out = down[1];
+		}
+		if (child == -1) throw std::runtime_error("fork failed");
+		::fcntl(out, F_SETFL, ::fcntl(out, F_GETFL) | O_NONBLOCK); // see take_actions
+	}
+
+private:
+	size_t batch;
+	size_t depth;
+	pid_t child;
+	int in;
+	int out;
+	uint32_t seq;
+	std::vector<uint8_t> outbox;
+	std::vector<uint8_t> inbox;
+
+	size_t calls;
+	size_t boards;
+	long long latency;
+	long long longest;
+	long long busy;
+};
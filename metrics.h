@@ -0,0 +1,249 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * metrics.h: Live metrics export for long-running jobs
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "agent.h"
+#include "statistics.h"
+
+/**
+ * metrics of the running process, exported in the Prometheus text format
+ *
+ * the game loop only updates lock-free counters once per episode (see metrics::record),
+ * and weight updates and value cache lookups are counted by weight_agent,
+ * while an exporter thread periodically takes snapshots, derives the rates over the last
+ * interval, and publishes them to a text file (rewritten atomically) and/or a Unix socket
+ *
+ * options (space-separated):
+ *  path=FILE: the text file to rewrite
+ *  socket=PATH: the Unix-domain socket to serve
+ *  interval=SEC: the update interval in seconds, 10 by default
+ */
+class metrics {
+public:
+	struct counters {
+		std::atomic<uint64_t> episodes;
+		std::atomic<uint64_t> score;
+		std::atomic<uint64_t> step[3]; // total, slider, placer
+		std::atomic<uint64_t> time[3]; // total, slider, placer
+		std::atomic<uint64_t> tiles[64]; // episodes by the largest tile
+		std::atomic<uint64_t> queued; // transitions queued to the learner, see pipeline_trainer
+	};
+
+	/**
+	 * the process-wide counters, zero-initialized as a static object
+	 */
+	static counters& global() { static counters c; return c; }
+
+	/**
+	 * count a finished episode
+	 */
+	static void record(const statistics::record& rec) {
+		counters& c = global();
+		c.episodes.fetch_add(1, std::memory_order_relaxed);
+		c.score.fetch_add(rec.score, std::memory_order_relaxed);
+		for (int i = 0; i < 3; i++) {
+			c.step[i].fetch_add(rec.step[i], std::memory_order_relaxed);
+			c.time[i].fetch_add(rec.time[i], std::memory_order_relaxed);
+		}
+		c.tiles[rec.tile].fetch_add(1, std::memory_order_relaxed);
+	}
+
+public:
+	metrics(const std::string& args = "") : interval(10), listener(-1), wakeup{ -1, -1 } {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			std::string value = pair.substr(pair.find('=') + 1);
+			if (key == "path") path = value;
+			if (key == "socket") socket = value;
+			if (key == "interval") interval = std::max(std::stod(value), 0.001);
+		}
+		if (path.empty() && socket.empty()) return;
+		if (socket.size()) listener = listen(socket);
+		if (::pipe(wakeup) != 0) wakeup[0] = wakeup[1] = -1;
+		exporter = std::thread(&metrics::run, this);
+	}
+	metrics(const metrics&) = delete;
+	metrics& operator =(const metrics&) = delete;
+	~metrics() {
+		if (exporter.joinable()) {
+			if (::write(wakeup[1], "", 1) != 1) {}
+			exporter.join();
+		}
+		for (int fd : { listener, wakeup[0], wakeup[1] }) if (fd != -1) ::close(fd);
+		if (listener != -1) ::unlink(socket.c_str());
+	}
+
+protected:
+	typedef std::chrono::steady_clock clock;
+
+	struct snapshot {
+		clock::time_point when;
+		uint64_t episodes, score, step[3], time[3], tiles[64], updates, hits, misses, queued;
+
+		snapshot() : when(clock::now()) {
+			counters& c = global();
+			episodes = c.episodes.load(std::memory_order_relaxed);
+			score = c.score.load(std::memory_order_relaxed);
+			for (int i = 0; i < 3; i++) {
+				step[i] = c.step[i].load(std::memory_order_relaxed);
+				time[i] = c.time[i].load(std::memory_order_relaxed);
+			}
+			for (int t = 0; t < 64; t++) tiles[t] = c.tiles[t].load(std::memory_order_relaxed);
+			queued = c.queued.load(std::memory_order_relaxed);
+			updates = weight_agent::updates().load(std::memory_order_relaxed);
+			hits = value_cache::hits().load(std::memory_order_relaxed);
+			misses = value_cache::misses().load(std::memory_order_relaxed);
+		}
+	};
+
+	/**
+	 * format the metrics of 'now', with rates derived from the difference to 'last'
+	 */
+	static std::string format(const snapshot& now, const snapshot& last) {
+		std::stringstream out;
+		double sec = std::chrono::duration<double>(now.when - last.when).count();
+		uint64_t eps = now.episodes - last.episodes;
+		const char* role[] = { "all", "slider", "placer" };
+		auto rate = [](double num, double den) { return den > 0 ? num / den : 0; };
+
+		out << "# TYPE game2048_episodes_total counter" << std::endl;
+		out << "game2048_episodes_total " << now.episodes << std::endl;
+		out << "# TYPE game2048_episodes_per_second gauge" << std::endl;
+		out << "game2048_episodes_per_second " << rate(eps, sec) << std::endl;
+		out << "# TYPE game2048_moves_total counter" << std::endl;
+		for (int i = 0; i < 3; i++)
+			out << "game2048_moves_total{role=\"" << role[i] << "\"} " << now.step[i] << std::endl;
+		out << "# TYPE game2048_moves_per_second gauge" << std::endl;
+		for (int i = 0; i < 3; i++)
+			out << "game2048_moves_per_second{role=\"" << role[i] << "\"} " << rate(now.step[i] - last.step[i], sec) << std::endl;
+		out << "# TYPE game2048_thinking_moves_per_second gauge" << std::endl;
+		for (int i = 0; i < 3; i++)
+			out << "game2048_thinking_moves_per_second{role=\"" << role[i] << "\"} "
+				<< rate((now.step[i] - last.step[i]) * 1000.0, now.time[i] - last.time[i]) << std::endl;
+		out << "# TYPE game2048_average_score gauge" << std::endl;
+		out << "game2048_average_score " << rate(now.score - last.score, eps) << std::endl;
+		out << "# TYPE game2048_max_tile_total counter" << std::endl;
+		for (int t = 0; t < 64; t++) {
+			if (now.tiles[t] == 0) continue;
+			out << "game2048_max_tile_total{tile=\"" << ((1ull << t) & -2ull) << "\"} " << now.tiles[t] << std::endl;
+		}
+		out << "# TYPE game2048_tile_reached_ratio gauge" << std::endl;
+		uint64_t accu = 0;
+		for (int t = 63; t >= 0; t--) {
+			accu += now.tiles[t] - last.tiles[t];
+			if (now.tiles[t] == 0) continue;
+			out << "game2048_tile_reached_ratio{tile=\"" << ((1ull << t) & -2ull) << "\"} " << rate(accu, eps) << std::endl;
+		}
+		out << "# TYPE game2048_weight_updates_total counter" << std::endl;
+		out << "game2048_weight_updates_total " << now.updates << std::endl;
+		out << "# TYPE game2048_weight_updates_per_second gauge" << std::endl;
+		out << "game2048_weight_updates_per_second " << rate(now.updates - last.updates, sec) << std::endl;
+		out << "# TYPE game2048_value_cache_lookups_total counter" << std::endl;
+		out << "game2048_value_cache_lookups_total{result=\"hit\"} " << now.hits << std::endl;
+		out << "game2048_value_cache_lookups_total{result=\"miss\"} " << now.misses << std::endl;
+		out << "# TYPE game2048_value_cache_hit_ratio gauge" << std::endl;
+		out << "game2048_value_cache_hit_ratio " << rate(now.hits - last.hits, (now.hits - last.hits) + (now.misses - last.misses)) << std::endl;
+		out << "# TYPE game2048_learner_queue_depth gauge" << std::endl;
+		out << "game2048_learner_queue_depth " << now.queued << std::endl;
+		out << "# TYPE process_resident_memory_bytes gauge" << std::endl;
+		out << "process_resident_memory_bytes " << resident() << std::endl;
+		return out.str();
+	}
+
+	static uint64_t resident() {
+		uint64_t size = 0, rss = 0;
+		std::ifstream statm("/proc/self/statm");
+		statm >> size >> rss;
+		return rss * ::sysconf(_SC_PAGESIZE);
+	}
+
+	/**
+	 * the exporter thread, which also serves the socket between updates
+	 */
+	void run() {
+		snapshot last;
+		std::string text = format(last, last);
+		auto next = last.when + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval));
+		publish(text);
+		for (bool stop = false; !stop; ) {
+			pollfd fds[2] = { { wakeup[0], POLLIN, 0 }, { listener, POLLIN, 0 } };
+			auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - clock::now()).count();
+			int ready = ::poll(fds, 2, std::max<long long>(wait, 0));
+			if (ready > 0 && fds[0].revents) stop = true;
+			if (ready > 0 && fds[1].revents) serve(text);
+			if (clock::now() >= next || stop) {
+				snapshot now;
+				text = format(now, last);
+				publish(text);
+				last = now;
+				next = now.when + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval));
+			}
+		}
+	}
+
+	/**
+	 * rewrite the text file atomically, by writing a temporary file then renaming it
+	 */
+	void publish(const std::string& text) {
+		if (path.empty()) return;
+		std::string temp = path + ".tmp";
+		std::ofstream out(temp, std::ios::out | std::ios::trunc);
+		out << text;
+		out.close();
+		if (out) std::rename(temp.c_str(), path.c_str());
+	}
+
+	void serve(const std::string& text) {
+		int fd = ::accept(listener, nullptr, nullptr);
+		if (fd == -1) return;
+		for (size_t done = 0; done < text.size(); ) {
+			ssize_t n = ::send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+			if (n <= 0) break;
+			done += n;
+		}
+		::close(fd);
+	}
+
+	static int listen(const std::string& path) {
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) return -1;
+		std::strcpy(addr.sun_path, path.c_str());
+		int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1) return -1;
+		::unlink(path.c_str());
+		if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0) {
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+private:
+	std::string path;
+	std::string socket;
+	double interval;
+	int listener;
+	int wakeup[2];
+	std::thread exporter;
+};
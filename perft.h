@@ -0,0 +1,190 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * perft.h: Exhaustive state enumeration for validation and throughput measurement
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unordered_set>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "board.h"
+
+/**
+ * perft-style enumeration of all slider moves and placer spawns (2 and 4 tiles) from a board,
+ * which counts the nodes and the unique positions at each depth
+ *
+ * the enumeration is split into subtrees at a shallow depth, which are distributed over threads
+ */
+class perft {
+public:
+	struct result {
+		std::vector<uint64_t> nodes; // nodes at depth 1, 2, ...
+		std::vector<uint64_t> unique; // unique positions at depth 1, 2, ... (if counted)
+		double sec;
+	};
+
+public:
+	/**
+	 * 'slide' indicates whether the slider moves first from the root
+	 */
+	perft(const board& root, bool slide = true, unsigned threads = std::thread::hardware_concurrency())
+		: root(root), slide(slide), threads(std::max(threads, 1u)) {}
+
+	result run(unsigned depth, bool unique = true) const {
+		auto start = std::chrono::steady_clock::now();
+		result res;
+		res.nodes.assign(depth, 0);
+		res.unique.assign(unique ? depth : 0, 0);
+
+		// expand the shallow levels until there are enough subtrees for the threads
+		std::vector<counter> local(threads, counter(depth, unique));
+		std::vector<board> frontier = { root };
+		unsigned split = 0;
+		while (split < depth && frontier.size() < threads * 16) {
+			std::vector<board> next;
+			for (const board& b : frontier)
+				expand(b, is_slide(split), [&](const board& n) { local[0].visit(n, split); next.push_back(n); });
+			frontier.swap(next);
+			split++;
+		}
+
+		std::atomic<size_t> task(0);
+		auto work = [&](size_t i) {
+			for (size_t t; (t = task++) < frontier.size(); ) search(frontier[t], split, local[i]);
+		};
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < threads; i++) workers.emplace_back(work, i);
+		work(0);
+		for (std::thread& worker : workers) worker.join();
+
+		for (unsigned d = 0; d < depth; d++) {
+			for (counter& c : local) res.nodes[d] += c.nodes[d];
+			if (!unique) continue;
+			for (size_t i = 1; i < threads; i++) local[0].seen[d].insert(local[i].seen[d].begin(), local[i].seen[d].end());
+			res.unique[d] = local[0].seen[d].size();
+		}
+		res.sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return res;
+	}
+
+	/**
+	 * print the result, one depth per line, followed by the speed
+	 */
+	static void show(const result& res, std::ostream& out = std::cout) {
+		uint64_t sum = 0;
+		for (size_t d = 0; d < res.nodes.size(); d++) {
+			out << "depth " << (d + 1) << "\t" "nodes = " << res.nodes[d];
+			if (d < res.unique.size()) out << ", unique = " << res.unique[d];
+			out << std::endl;
+			sum += res.nodes[d];
+		}
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(0);
+		out << "total\t" "nodes = " << sum << ", ops = " << (sum / std::max(res.sec, 1e-9)) << std::endl << std::endl;
+		out.copyfmt(ff);
+	}
+
+	/**
+	 * verify the node counts of the reference positions (4x4 only), which were
+	 * enumerated with the original rotation-based board before the slide kernels
+	 * return false if any count mismatches
+	 */
+	static bool check(unsigned threads = std::thread::hardware_concurrency(), std::ostream& out = std::cout) {
+		struct reference {
+			const char* board;
+			bool slide;
+			std::vector<uint64_t> nodes;
+		};
+		const std::vector<reference> refs = {
+			{ "0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0", false,
+				{ 32, 96, 2880, 10464, 295296, 1092672, 29400960 } },
+			{ "2 0 0 0 0 0 0 0 0 0 0 0 0 0 2 0", true,
+				{ 4, 112, 422, 11492, 42966, 1119920, 4171286 } },
+			{ "2 4 8 16 32 64 128 256 512 1024 2048 4096 0 0 0 2", true,
+				{ 2, 12, 35, 160, 475, 1792, 4981 } },
+			{ "0 2 2 4 0 4 8 8 16 0 16 32 2 2 2 2", true,
+				{ 4, 44, 171, 2660, 9697, 158842, 572726 } },
+			{ "32768 32768 65536 2 0 4 0 2 8 0 0 4 0 0 2 2", true, // lines beyond the lookup table
+				{ 4, 60, 236, 3728, 13927, 227394, 842077 } },
+		};
+		if (board::size != 16) {
+			out << "perft: reference positions are for 4x4 boards" << std::endl;
+			return true;
+		}
+		bool pass = true;
+		for (const reference& ref : refs) {
+			board b;
+			std::stringstream(ref.board) >> b;
+			result res = perft(b, ref.slide, threads).run(ref.nodes.size(), false);
+			bool ok = (res.nodes == ref.nodes);
+			out << (ok ? "pass" : "FAIL") << "\t" << ref.board << (ref.slide ? " (slide)" : " (place)");
+			for (size_t d = 0; d < res.nodes.size() && !ok; d++)
+				if (res.nodes[d] != ref.nodes[d]) out << ", depth " << (d + 1) << ": " << res.nodes[d] << " != " << ref.nodes[d];
+			out << std::endl;
+			pass &= ok;
+		}
+		out << std::endl;
+		return pass;
+	}
+
+protected:
+	struct counter {
+		std::vector<uint64_t> nodes;
+		std::vector<std::unordered_set<uint64_t>> seen;
+		counter(unsigned depth, bool unique) : nodes(depth, 0), seen(unique ? depth : 0) {}
+		void visit(const board& b, unsigned ply) {
+			nodes[ply]++;
+			if (seen.size()) seen[ply].insert(b.hash());
+		}
+	};
+
+	bool is_slide(unsigned ply) const { return (ply % 2 == 0) == slide; }
+
+	/**
+	 * call f(child) for each child of a board, by sliding or by placing
+	 */
+	template<typename visitor>
+	static void expand(const board& b, bool slide, visitor f) {
+		if (slide) {
+			for (unsigned op = 0; op < 4; op++) {
+				board n = b;
+				if (n.slide(op) != -1) f(n);
+			}
+		} else {
+			for (unsigned pos = 0; pos < board::size; pos++) {
+				for (board::cell tile = 1; tile <= 2; tile++) {
+					board n = b;
+					if (n.place(pos, tile) != -1) f(n);
+				}
+			}
+		}
+	}
+
+	/**
+	 * depth-first search from a board at 'ply', where the board itself has been counted
+	 */
+	void search(const board& b, unsigned ply, counter& c) const {
+		if (ply >= c.nodes.size()) return;
+		expand(b, is_slide(ply), [&](const board& n) {
+			c.visit(n, ply);
+			search(n, ply + 1, c);
+		});
+	}
+
+private:
+	board root;
+	bool slide;
+	unsigned threads;
+};
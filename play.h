@@ -0,0 +1,135 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * play.h: Game loops between a slider and a placer
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+#include "metrics.h"
+
+/**
+ * the game loop of the program, which plays episodes and records them to the statistics
+ *
+ * with games = 1, the episodes are played one by one; otherwise, 'games' episodes are played
+ * concurrently in lockstep, so that each agent takes actions in batches, and a slider with
+ * an n-tuple network learns from the finished episodes instead of its own path
+ *
+ * the buffers are kept across calls of run, so that no allocation happens in the steady state
+ */
+class game_loop {
+public:
+	game_loop(agent& slide, agent& place, size_t games = 1) : slide(slide), place(place),
+		slide_flag("~:" + place.name()), place_flag(slide.name() + ":~"), game_flag(slide.name() + ":" + place.name()),
+		learner(dynamic_cast<greedy_slider*>(&slide)), play(std::max(games, size_t(1))) {}
+
+	/**
+	 * play until the statistics are finished, or at most 'num' more episodes are recorded
+	 */
+	void run(statistics& stats, size_t num = -1) {
+		num = std::min(num, stats.remain());
+		if (play.size() == 1) {
+			single(stats, num);
+		} else {
+			lockstep(stats, num);
+		}
+	}
+
+protected:
+	void single(statistics& stats, size_t num) {
+		for (size_t n = 0; n < num; n++) {
+//			std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
+			slide.open_episode(slide_flag);
+			place.open_episode(place_flag);
+
+			stats.open_episode(game_flag);
+			episode& game = stats.back();
+			while (true) {
+				agent& who = game.take_turns(slide, place);
+				action move = who.take_action(game.state());
+//				std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+			}
+			agent& win = game.last_turns(slide, place);
+			stats.close_episode(win.name());
+			metrics::record(stats.back());
+
+			slide.close_episode(win.name());
+			place.close_episode(win.name());
+		}
+	}
+
+	void lockstep(statistics& stats, size_t num) {
+		size_t queued = 0;
+		auto open = [&](size_t i) {
+			slide.open_episode(slide_flag);
+			place.open_episode(place_flag);
+			play[i].reset();
+			play[i].open_episode(game_flag);
+			active.push_back(i);
+			queued++;
+		};
+		active.clear();
+		for (size_t i = 0; i < play.size() && queued < num; i++) open(i);
+		time_t last = episode::millisec(); // the time of a batch is shared by its games
+		while (active.size()) {
+			turns[0].clear();
+			turns[1].clear();
+			for (size_t i : active) turns[&play[i].take_turns(slide, place) == &slide].push_back(i);
+			active.clear();
+			for (int t = 0; t < 2; t++) {
+				agent& who = t ? slide : place;
+				before.clear();
+				for (size_t i : turns[t]) before.push_back(play[i].state());
+				moves.resize(before.size());
+				who.take_actions(before.data(), moves.data(), before.size());
+				time_t spent = episode::millisec() - last; // including the bookkeeping since the last batch
+				last += spent;
+				for (size_t k = 0; k < turns[t].size(); k++) {
+					episode& game = play[turns[t][k]];
+					time_t time = spent / turns[t].size() + (k < spent % turns[t].size());
+					if (game.apply_action(moves[k], time) && !who.check_for_win(game.state())) {
+						active.push_back(turns[t][k]);
+						continue;
+					}
+					agent& win = game.last_turns(slide, place);
+					game.close_episode(win.name(), game.time(action::slide::type) + game.time(action::place::type));
+					stats.close_episode(game);
+					metrics::record(stats.back());
+					if (learner && learner->rate()) {
+						path.clear();
+						stats.back().replay([&](const board& after, board::reward reward) { path.push_back({ after, reward }); });
+						learner->learn(path.data(), path.size());
+					}
+
+					slide.close_episode(win.name());
+					place.close_episode(win.name());
+					if (queued < num) open(turns[t][k]);
+				}
+			}
+		}
+	}
+
+private:
+	agent& slide;
+	agent& place;
+	const std::string slide_flag;
+	const std::string place_flag;
+	const std::string game_flag;
+	greedy_slider* learner;
+	std::vector<episode> play;
+	std::vector<size_t> active, turns[2];
+	std::vector<board> before;
+	std::vector<action> moves;
+	std::vector<weight_agent::transition> path;
+};
@@ -0,0 +1,133 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * profile.h: Access profiler for weight tables
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include "weight.h"
+
+/**
+ * access profile of weight tables, which is enabled by weight_agent with profile=PATH
+ *
+ * each table keeps a touch bitmap (one bit per entry), exact read/write counters,
+ * and access counts per 4KB page sampled randomly with a probability of 1/sample;
+ * the report gives the occupied fraction of entries, cache lines, and pages,
+ * the hot-page set that covers most of the sampled accesses, and the accesses per episode
+ */
+class weight_profile {
+public:
+	static constexpr size_t line = 64 / sizeof(weight::type); // entries per cache line
+	static constexpr size_t page = 4096 / sizeof(weight::type); // entries per page
+	static constexpr unsigned sample = 64;
+
+public:
+	weight_profile() : episodes(0) {}
+
+	/**
+	 * start profiling the tables, i.e., the profile is disabled until this is called
+	 */
+	void attach(const std::vector<weight>& net) {
+		tables.clear();
+		for (const weight& w : net) tables.emplace_back(new table(w.size()));
+	}
+	bool enabled() const { return tables.size(); }
+
+	void read(size_t i, size_t index) { access(*tables[i], index, tables[i]->reads); }
+	void write(size_t i, size_t index) { access(*tables[i], index, tables[i]->writes); }
+	void episode() { episodes.fetch_add(1, std::memory_order_relaxed); }
+
+	/**
+	 * print the report, where 'names' labels the tables
+	 */
+	void report(std::ostream& out, const std::vector<std::string>& names = {}) const {
+		size_t eps = std::max<size_t>(episodes, 1);
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(2);
+		out << "weight profile: " << tables.size() << " tables, " << episodes << " episodes, ";
+		out << "1/" << sample << " of accesses sampled per page" << std::endl;
+		for (size_t i = 0; i < tables.size(); i++) {
+			const table& t = *tables[i];
+			size_t entries = 0, lines = 0, pages = 0;
+			for (size_t k = 0; k < t.size; k += line) {
+				size_t num = 0;
+				for (size_t e = k; e < std::min(k + line, t.size); e++) num += t.touched(e);
+				entries += num;
+				lines += (num != 0);
+				if (k % page == 0) pages += t.touched_page(k);
+			}
+			size_t total_lines = (t.size + line - 1) / line, total_pages = t.count.size();
+			out << "table " << i << (i < names.size() ? " (" + names[i] + ")" : "") << ": ";
+			out << t.size << " entries, occupied = " << (entries * 100.0 / t.size) << "% entries, ";
+			out << (lines * 100.0 / total_lines) << "% lines, " << (pages * 100.0 / total_pages) << "% pages" << std::endl;
+			out << "\t" "reads = " << (t.reads * 1.0 / eps) << " / episode, ";
+			out << "writes = " << (t.writes * 1.0 / eps) << " / episode" << std::endl;
+			out << "\t" "hot pages = " << hot(t, 0.9) << " (90%), " << hot(t, 0.99) << " (99%) of " << total_pages;
+			out << " pages (" << (total_pages * 4) << "KB)" << std::endl;
+		}
+		out << std::endl;
+		out.copyfmt(ff);
+	}
+
+protected:
+	struct table {
+		size_t size;
+		std::vector<std::atomic<uint64_t>> bits; // one bit per entry
+		std::vector<std::atomic<uint32_t>> count; // sampled accesses per page
+		std::atomic<uint64_t> reads;
+		std::atomic<uint64_t> writes;
+
+		table(size_t size) : size(size), bits((size + 63) / 64), count((size + page - 1) / page), reads(0), writes(0) {
+			for (auto& b : bits) b.store(0, std::memory_order_relaxed);
+			for (auto& c : count) c.store(0, std::memory_order_relaxed);
+		}
+		bool touched(size_t e) const { return bits[e / 64].load(std::memory_order_relaxed) >> (e % 64) & 1; }
+		bool touched_page(size_t k) const {
+			for (size_t w = k / 64; w < std::min((k + page) / 64, bits.size()); w++)
+				if (bits[w].load(std::memory_order_relaxed)) return true;
+			return false;
+		}
+	};
+
+	static void access(table& t, size_t index, std::atomic<uint64_t>& counter) {
+		static thread_local uint32_t seed = 2463534242u; // xorshift, which avoids aliasing with the table order
+		uint64_t bit = 1ull << (index % 64);
+		std::atomic<uint64_t>& word = t.bits[index / 64];
+		if (!(word.load(std::memory_order_relaxed) & bit)) word.fetch_or(bit, std::memory_order_relaxed);
+		counter.fetch_add(1, std::memory_order_relaxed);
+		seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+		if (seed % sample == 0) t.count[index / page].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * the fewest pages that cover 'ratio' of the sampled accesses
+	 */
+	static size_t hot(const table& t, double ratio) {
+		std::vector<uint32_t> count;
+		uint64_t sum = 0;
+		for (auto& c : t.count) {
+			count.push_back(c.load(std::memory_order_relaxed));
+			sum += count.back();
+		}
+		std::sort(count.begin(), count.end(), std::greater<uint32_t>());
+		size_t num = 0;
+		for (uint64_t accu = 0; num < count.size() && accu < sum * ratio; accu += count[num++]);
+		return num;
+	}
+
+private:
+	std::vector<std::unique_ptr<table>> tables;
+	std::atomic<uint64_t> episodes;
+};
@@ -12,10 +12,83 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "board.h"
 #include "action.h"
 #include "episode.h"
 
+/**
+ * read-only memory map of a record file (one episode per line), shared by the loaders
+ * the records end at the end of the file or at the first empty line, whatever follows is ignored
+ */
+class record_file {
+public:
+	/**
+	 * map the file, with the pages read ahead if it will be read in order
+	 */
+	record_file(const std::string& path, bool sequential = false) : text(nullptr), last(nullptr), len(0), stamp(0), good(false) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd == -1) return;
+		struct stat st;
+		if (::fstat(fd, &st) == 0) len = st.st_size, stamp = modified(st);
+		void* map = len ? ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		::close(fd);
+		good = (len == 0 || map != MAP_FAILED);
+		if (map == MAP_FAILED) return;
+		text = static_cast<const char*>(map);
+		if (sequential) ::madvise(map, len, MADV_SEQUENTIAL);
+		static const char blank[] = "\n\n";
+		last = (*text == '\n') ? text : std::min(std::search(text, text + len, blank, blank + 2) + 1, text + len);
+	}
+	record_file(const record_file&) = delete;
+	record_file& operator =(const record_file&) = delete;
+	~record_file() {
+		if (text) ::munmap(const_cast<char*>(text), len);
+	}
+
+	/**
+	 * whether the file is mapped, note that an empty file has no records but is still open
+	 */
+	bool is_open() const { return good; }
+	const char* begin() const { return text; }
+	const char* end() const { return last; }
+	size_t size() const { return len; }
+	int64_t mtime() const { return stamp; }
+
+	/**
+	 * split the records into 'num' line-aligned chunks, and return the num + 1 boundaries
+	 */
+	std::vector<const char*> split(size_t num) const {
+		std::vector<const char*> bound = { text };
+		for (size_t i = 1; i < num; i++) {
+			const char* it = std::max(text + (last - text) * i / num, bound.back());
+			bound.push_back(std::min(std::find(it, last, '\n') + 1, last));
+		}
+		bound.push_back(last);
+		return bound;
+	}
+
+	/**
+	 * the modification time of a file in nanoseconds
+	 */
+	static int64_t modified(const struct stat& st) { return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec; }
+
+private:
+	const char* text;
+	const char* last;
+	size_t len;
+	int64_t stamp;
+	bool good;
+};
+
 class statistics {
 public:
 	/**
@@ -29,7 +102,78 @@ public:
 		: total(total),
 		  block(block ? block : total),
 		  limit(limit ? limit : total),
-		  count(0) {}
+		  count(0),
+		  head(0) {}
+
+public:
+	/**
+	 * brief record of an episode, which is sufficient for making reports
+	 * the layout is fixed since records are also stored in archive indexes
+	 */
+	struct record {
+		uint64_t score;
+		uint32_t tile; // the largest tile (index value)
+		uint32_t step[3]; // total, slider, placer
+		int64_t time[3]; // total, slider, placer
+		record() : score(0), tile(0), step(), time() {}
+		record(const episode& ep) : score(ep.score()),
+			tile(*std::max_element(ep.state().begin(), ep.state().end())),
+			step{ uint32_t(ep.step()), uint32_t(ep.step(action::slide::type)), uint32_t(ep.step(action::place::type)) },
+			time{ ep.time(), ep.time(action::slide::type), ep.time(action::place::type) } {}
+	};
+
+	/**
+	 * accumulated records of a set of episodes
+	 */
+	struct report {
+		size_t num = 0;
+		size_t stat[64] = { 0 };
+		size_t sop = 0, pop = 0, eop = 0;
+		time_t sdu = 0, pdu = 0, edu = 0;
+		board::score sum = 0, max = 0;
+
+		report& operator +=(const record& rec) {
+			num++;
+			sum += rec.score;
+			max = std::max(board::score(rec.score), max);
+			stat[rec.tile]++;
+			sop += rec.step[0];
+			pop += rec.step[1];
+			eop += rec.step[2];
+			sdu += rec.time[0];
+			pdu += rec.time[1];
+			edu += rec.time[2];
+			return *this;
+		}
+
+		/**
+		 * print the report in the format of statistics::show, labeled by 'index'
+		 */
+		void show(size_t index, bool tstat = true) const {
+			std::ios ff(nullptr);
+			ff.copyfmt(std::cout);
+			std::cout << std::fixed << std::setprecision(0);
+			std::cout << index << "\t";
+			std::cout << "avg = " << (sum / num) << ", ";
+			std::cout << "max = " << (max) << ", ";
+			std::cout << "ops = " << (sop * 1000.0 / sdu);
+			std::cout <<     " (" << (pop * 1000.0 / pdu);
+			std::cout <<      "|" << (eop * 1000.0 / edu) << ")";
+			std::cout << std::endl;
+			std::cout.copyfmt(ff);
+
+			if (!tstat) return;
+			for (size_t t = 0, c = 0; c < num; c += stat[t++]) {
+				if (stat[t] == 0) continue;
+				size_t accu = std::accumulate(std::begin(stat) + t, std::end(stat), size_t(0));
+				std::cout << "\t" << ((1 << t) & -2u); // type
+				std::cout << "\t" << (accu * 100.0 / num) << "%"; // win rate
+				std::cout << "\t" "(" << (stat[t] * 100.0 / num) << "%" ")"; // percentage of ending
+				std::cout << std::endl;
+			}
+			std::cout << std::endl;
+		}
+	};
 
 public:
 	/**
@@ -55,46 +199,9 @@ public:
 	 */
 	void show(bool tstat = true, size_t blk = 0) const {
 		size_t num = std::min(data.size(), blk ?: block);
-		size_t stat[64] = { 0 };
-		size_t sop = 0, pop = 0, eop = 0;
-		time_t sdu = 0, pdu = 0, edu = 0;
-		board::score sum = 0, max = 0;
-		auto it = data.end();
-		for (size_t i = 0; i < num; i++) {
-			auto& ep = *(--it);
-			sum += ep.score();
-			max = std::max(ep.score(), max);
-			stat[*std::max_element(ep.state().begin(), ep.state().end())]++;
-			sop += ep.step();
-			pop += ep.step(action::slide::type);
-			eop += ep.step(action::place::type);
-			sdu += ep.time();
-			pdu += ep.time(action::slide::type);
-			edu += ep.time(action::place::type);
-		}
-
-		std::ios ff(nullptr);
-		ff.copyfmt(std::cout);
-		std::cout << std::fixed << std::setprecision(0);
-		std::cout << count << "\t";
-		std::cout << "avg = " << (sum / num) << ", ";
-		std::cout << "max = " << (max) << ", ";
-		std::cout << "ops = " << (sop * 1000.0 / sdu);
-		std::cout <<     " (" << (pop * 1000.0 / pdu);
-		std::cout <<      "|" << (eop * 1000.0 / edu) << ")";
-		std::cout << std::endl;
-		std::cout.copyfmt(ff);
-
-		if (!tstat) return;
-		for (size_t t = 0, c = 0; c < num; c += stat[t++]) {
-			if (stat[t] == 0) continue;
-			size_t accu = std::accumulate(std::begin(stat) + t, std::end(stat), size_t(0));
-			std::cout << "\t" << ((1 << t) & -2u); // type
-			std::cout << "\t" << (accu * 100.0 / num) << "%"; // win rate
-			std::cout << "\t" "(" << (stat[t] * 100.0 / num) << "%" ")"; // percentage of ending
-			std::cout << std::endl;
-		}
-		std::cout << std::endl;
+		report rpt;
+		for (size_t i = data.size() - num; i < data.size(); i++) rpt += record(slot(i));
+		rpt.show(count, tstat);
 	}
 
 	void summary() const {
@@ -105,48 +212,146 @@ public:
 		return count >= total;
 	}
 
+	size_t remain() const {
+		return count < total ? total - count : 0;
+	}
+
+	/**
+	 * open a new episode, which reuses the oldest record once the limit is reached,
+	 * so that no allocation happens in the steady state
+	 */
 	void open_episode(const std::string& flag = "") {
-		if (count++ >= limit) data.pop_front();
-		data.emplace_back();
-		data.back().open_episode(flag);
+		if (count++ >= limit && data.size()) {
+			head = (head + 1) % data.size();
+			back().reset();
+		} else {
+			rewind();
+			data.emplace_back();
+		}
+		back().open_episode(flag);
 	}
 
 	void close_episode(const std::string& flag = "") {
-		data.back().close_episode(flag);
+		back().close_episode(flag);
+		if (count % block == 0) show();
+	}
+
+	/**
+	 * append an episode closed elsewhere, e.g., by an actor thread
+	 * the episode is swapped in, and 'ep' receives the reused record
+	 */
+	void close_episode(episode& ep) {
+		open_episode();
+		std::swap(back(), ep);
 		if (count % block == 0) show();
 	}
 
 	episode& at(size_t i) {
-		return data.at(i);
+		if (i >= data.size()) throw std::out_of_range("statistics::at");
+		return slot(i);
+	}
+	const episode& at(size_t i) const {
+		if (i >= data.size()) throw std::out_of_range("statistics::at");
+		return slot(i);
 	}
 	episode& front() {
-		return data.front();
+		return slot(0);
 	}
 	episode& back() {
-		return data.back();
+		return slot(data.size() - 1);
 	}
 	size_t step() const {
 		return count;
 	}
+	size_t size() const {
+		return data.size();
+	}
+
+	/**
+	 * append a finished episode, e.g., one fetched from an archive
+	 */
+	void push_back(episode&& ep) {
+		rewind();
+		data.push_back(std::move(ep));
+		count++;
+		total = std::max(total, count);
+	}
 
 	friend std::ostream& operator <<(std::ostream& out, const statistics& stat) {
-		for (const episode& rec : stat.data) out << rec << std::endl;
+		for (size_t i = 0; i < stat.data.size(); i++) out << stat.slot(i) << std::endl;
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, statistics& stat) {
+		stat.rewind();
+		episode ep;
 		for (std::string line; std::getline(in, line) && line.size(); ) {
-			stat.data.emplace_back();
-			std::stringstream(line) >> stat.data.back();
+			ep.decode(line.data(), line.data() + line.size());
+			stat.data.push_back(ep); // the copy takes only the storage it needs
 		}
 		stat.total = std::max(stat.total, stat.data.size());
 		stat.count = stat.data.size();
 		return in;
 	}
 
+	/**
+	 * load the records from a file, equivalent to operator >> but much faster for large files
+	 * the file is memory-mapped and split into line-aligned chunks, which are decoded in parallel
+	 * return false if the file cannot be mapped
+	 */
+	bool load(const std::string& path, unsigned threads = std::thread::hardware_concurrency()) {
+		record_file file(path, true);
+		if (!file.is_open()) return false;
+
+		// split the records into line-aligned chunks, at least 1MB each
+		size_t num = std::max(std::min<size_t>(threads, file.size() >> 20), size_t(1));
+		std::vector<const char*> split = file.split(num);
+		std::vector<std::vector<episode>> chunks(num);
+		auto decode = [&](size_t i) {
+			episode ep;
+			for (const char* it = split[i]; it < split[i + 1]; ) {
+				const char* eol = std::find(it, split[i + 1], '\n');
+				ep.decode(it, eol);
+				chunks[i].push_back(ep); // the copy takes only the storage it needs
+				it = eol + 1;
+			}
+		};
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < num; i++) workers.emplace_back(decode, i);
+		decode(0);
+		for (std::thread& worker : workers) worker.join();
+
+		// assemble the records in order
+		rewind();
+		for (std::vector<episode>& chunk : chunks)
+			std::move(chunk.begin(), chunk.end(), std::back_inserter(data));
+		total = std::max(total, data.size());
+		count = data.size();
+		return true;
+	}
+
+protected:
+	/**
+	 * the records are kept as a ring, where the oldest one is at 'head'
+	 */
+	episode& slot(size_t i) {
+		return data[(head + i) % data.size()];
+	}
+	const episode& slot(size_t i) const {
+		return data[(head + i) % data.size()];
+	}
+	/**
+	 * rotate the ring to start at the front, before appending records
+	 */
+	void rewind() {
+		std::rotate(data.begin(), data.begin() + head, data.end());
+		head = 0;
+	}
+
 private:
 	size_t total;
 	size_t block;
 	size_t limit;
 	size_t count;
+	size_t head;
 	std::deque<episode> data;
 };
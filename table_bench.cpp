@@ -0,0 +1,111 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * table_bench.cpp: Random-read benchmark of weight tables against plain vectors
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "weight.h"
+
+/**
+ * counter of dTLB read misses of this thread, which is unavailable (-1) without perf permission
+ */
+class tlb_misses {
+public:
+	tlb_misses() {
+		perf_event_attr pe = {};
+		pe.size = sizeof(pe);
+		pe.type = PERF_TYPE_HW_CACHE;
+		pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		pe.disabled = 1;
+		pe.exclude_kernel = 1;
+		fd = ::syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+		if (fd != -1) ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	~tlb_misses() { if (fd != -1) ::close(fd); }
+	long long stop() {
+		long long count = -1;
+		if (fd == -1) return count;
+		::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (::read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+		return count;
+	}
+private:
+	int fd;
+};
+
+/**
+ * the anonymous memory of this process backed by transparent huge pages, in kB
+ */
+size_t huge_pages() {
+	std::ifstream smaps("/proc/self/smaps_rollup");
+	size_t kb = 0;
+	for (std::string key; smaps >> key; smaps.ignore(256, '\n'))
+		if (key == "AnonHugePages:" && smaps >> kb) break;
+	return kb;
+}
+
+/**
+ * read the entries at 'index' from the tables in turn, and show the time and the dTLB misses
+ */
+template<typename table>
+void run(const std::string& name, const std::vector<table>& net, const std::vector<uint32_t>& index) {
+	float sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	tlb_misses misses;
+	for (size_t k = 0; k < index.size(); k++) sum += net[k % net.size()][index[k]];
+	long long count = misses.stop();
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << name << ": " << sec << "s, " << (index.size() / sec / 1e6) << "M reads/s, ";
+	std::cout << "dTLB misses = " << (count != -1 ? std::to_string(count) : "n/a") << ", ";
+	std::cout << "huge pages = " << (huge_pages() >> 10) << "MB (checksum " << sum << ")" << std::endl;
+}
+
+/**
+ * options (space-separated):
+ *  tables=N: the number of tables, 8 by default
+ *  size=N: the entries per table, 16M by default (64MB)
+ *  reads=N: the number of random reads, 16M by default
+ */
+int main(int argc, const char* argv[]) {
+	size_t tables = 8, size = 1 << 24, reads = 1 << 24;
+	std::stringstream ss(argc > 1 ? argv[1] : "");
+	for (std::string pair; ss >> pair; ) {
+		std::string key = pair.substr(0, pair.find('='));
+		std::string value = pair.substr(pair.find('=') + 1);
+		if (key == "tables") tables = std::max(std::stoull(value), 1ull);
+		if (key == "size") size = std::max(std::stoull(value), 1ull);
+		if (key == "reads") reads = std::stoull(value);
+	}
+	std::cout << "table_bench: " << tables << " tables of " << size << " entries, " << reads << " random reads" << std::endl;
+
+	std::mt19937 rng(1);
+	std::vector<uint32_t> index(reads);
+	for (uint32_t& i : index) i = std::uniform_int_distribution<uint32_t>(0, size - 1)(rng);
+	{
+		std::vector<std::vector<weight::type>> net(tables, std::vector<weight::type>(size));
+		run("std::vector<float>", net, index);
+	}
+	{
+		std::vector<weight> net;
+		for (size_t i = 0; i < tables; i++) net.emplace_back(size);
+		run("table_allocator   ", net, index);
+	}
+	return 0;
+}
@@ -0,0 +1,393 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * trainer.h: Training pipelines for weight agents
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "board.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+#include "metrics.h"
+
+/**
+ * offline training from saved episodes
+ *
+ * decoder threads split the record file into line-aligned chunks, decode the episodes,
+ * and replay them into transitions (afterstates with rewards), which are queued in batches;
+ * the learner (the calling thread) applies weight_agent::learn to the batches as they arrive,
+ * so that the training speed is bounded by the table updates rather than the parsing
+ */
+class offline_trainer {
+public:
+	/**
+	 * a batch of episodes, stored as consecutive transitions with the end of each episode
+	 */
+	struct batch {
+		std::vector<weight_agent::transition> path;
+		std::vector<size_t> ends;
+	};
+
+public:
+	offline_trainer(weight_agent& learner, unsigned decoders = std::thread::hardware_concurrency(),
+			size_t episodes = 64, size_t depth = 4)
+		: learner(learner), decoders(std::max(decoders, 1u)), episodes(std::max(episodes, size_t(1))),
+		  depth(std::max(depth, size_t(1))), running(0) {}
+
+	/**
+	 * train the learner with all episodes of a record file
+	 * return the number of episodes learned, or exit if the file cannot be mapped
+	 */
+	size_t train(const std::string& path) {
+		record_file file(path, true);
+		if (!file.is_open()) {
+			std::cerr << "cannot open " << path << " for training" << std::endl;
+			std::exit(-1);
+		}
+		std::vector<const char*> split = file.split(decoders);
+
+		running = decoders;
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < decoders; i++) workers.emplace_back(&offline_trainer::decode, this, split[i], split[i + 1]);
+
+		auto start = std::chrono::steady_clock::now();
+		size_t count = 0, steps = 0;
+		for (batch b; take(b); ) {
+			for (size_t k = 0, head = 0; k < b.ends.size(); head = b.ends[k++]) {
+				learner.learn(b.path.data() + head, b.ends[k] - head);
+				learner.weight_agent::close_episode();
+			}
+			count += b.ends.size();
+			steps += b.path.size();
+		}
+		for (std::thread& worker : workers) worker.join();
+
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::ios ff(nullptr);
+		ff.copyfmt(std::cout);
+		std::cout << std::fixed << std::setprecision(0);
+		std::cout << "learned " << count << " episodes (" << steps << " afterstates), ";
+		std::cout << "ops = " << (steps / std::max(sec, 1e-9)) << std::endl << std::endl;
+		std::cout.copyfmt(ff);
+		return count;
+	}
+
+protected:
+	/**
+	 * the decoder thread, which handles the lines in [begin, end)
+	 */
+	void decode(const char* begin, const char* end) {
+		episode ep;
+		batch b;
+		for (const char* it = begin; it < end; ) {
+			const char* eol = std::find(it, end, '\n');
+			ep.decode(it, eol);
+			ep.replay([&](const board& after, board::reward reward) { b.path.push_back({ after, reward }); });
+			b.ends.push_back(b.path.size());
+			it = eol + 1;
+			if (b.ends.size() >= episodes) {
+				give(std::move(b));
+				b = {};
+			}
+		}
+		if (b.ends.size()) give(std::move(b));
+		std::lock_guard<std::mutex> lock(mtx);
+		running--;
+		cv.notify_all();
+	}
+
+	/**
+	 * queue a batch, which waits while the queue holds 'depth' batches per decoder
+	 */
+	void give(batch&& b) {
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [&] { return queue.size() < depth * decoders; });
+		queue.push_back(std::move(b));
+		cv.notify_all();
+	}
+
+	/**
+	 * take a batch, or return false if all decoders are finished
+	 */
+	bool take(batch& b) {
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [&] { return queue.size() || running == 0; });
+		if (queue.empty()) return false;
+		b = std::move(queue.front());
+		queue.pop_front();
+		cv.notify_all();
+		return true;
+	}
+
+private:
+	weight_agent& learner;
+	size_t decoders;
+	size_t episodes;
+	size_t depth;
+	size_t running;
+	std::deque<batch> queue;
+	std::mutex mtx;
+	std::condition_variable cv;
+};
+
+/**
+ * bounded single-producer/single-consumer ring buffer
+ * items are exchanged by swapping, so that their storage (e.g., of episodes) is recycled
+ */
+template<typename T>
+class spsc_ring {
+public:
+	spsc_ring(size_t capacity) : slots(ceil2(capacity)), mask(slots.size() - 1), head(0), tail(0) {}
+	spsc_ring(const spsc_ring&) = delete;
+	spsc_ring& operator =(const spsc_ring&) = delete;
+
+	/**
+	 * swap an item into the ring, return false if the ring is full (producer only)
+	 */
+	bool push(T& item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+		std::swap(slots[t & mask], item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * swap an item out of the ring, return false if the ring is empty (consumer only)
+	 */
+	bool pop(T& item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (tail.load(std::memory_order_acquire) == h) return false;
+		std::swap(item, slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+	size_t capacity() const { return slots.size(); }
+
+protected:
+	static size_t ceil2(size_t n) {
+		size_t p = 1;
+		while (p < n) p <<= 1;
+		return p;
+	}
+
+private:
+	std::vector<T> slots;
+	size_t mask;
+	std::atomic<size_t> head;
+	char gap[64]; // keep the indices of the consumer and the producer on separate cache lines
+	std::atomic<size_t> tail;
+};
+
+/**
+ * pipelined training, where actor threads play and a learner thread updates the weights
+ *
+ * each actor plays episodes with the greedy policy of the learner, reading the weights while
+ * they are being updated (through relaxed atomic loads, so a read may be stale but never torn),
+ * and streams the transitions to the learner through its own SPSC ring, followed by the closed episode;
+ * the learner (the calling thread) drains the rings, applies weight_agent::learn once an episode
+ * is complete, and records the episode to the statistics
+ *
+ * options (space-separated):
+ *  actors=N: the number of actor threads, the number of cores minus one by default
+ *  ring=N: the capacity of each transition ring, 65536 by default
+ *  stale=N: the maximum number of finished episodes of an actor not yet learned, 4 by default
+ */
+class pipeline_trainer {
+public:
+	/**
+	 * a record of an actor, i.e., a transition, or the end of an episode
+	 */
+	struct record {
+		weight_agent::transition step;
+		bool end;
+	};
+
+public:
+	pipeline_trainer(greedy_slider& learner, const std::string& args = "") : learner(learner),
+		actors(std::max(std::thread::hardware_concurrency(), 2u) - 1), ring(65536), stale(4) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			std::string value = pair.substr(pair.find('=') + 1);
+			if (key == "actors") actors = std::max(std::stoul(value), 1ul);
+			if (key == "ring") ring = std::max(std::stoul(value), 1ul);
+			if (key == "stale") stale = std::max(std::stoul(value), 1ul);
+		}
+	}
+
+	/**
+	 * play and learn until the statistics are finished, with placers created from 'place_args'
+	 * actor i seeds its placer with the given seed (0 by default) plus i
+	 */
+	void run(statistics& stats, const std::string& place_args) {
+		std::atomic<size_t> remain(stats.remain());
+		std::vector<std::unique_ptr<lane>> lanes;
+		for (size_t i = 0; i < actors; i++) lanes.emplace_back(new lane(ring, stale));
+		int seed = std::stoi(agent("seed=0 " + place_args).property("seed"));
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < actors; i++)
+			workers.emplace_back(&pipeline_trainer::act, this, std::ref(*lanes[i]), std::ref(remain),
+				place_args + " seed=" + std::to_string(seed + i));
+
+		auto start = clock::now();
+		std::vector<std::vector<weight_agent::transition>> paths(actors);
+		for (auto& path : paths) path.reserve(10000);
+		episode ep;
+		record rec;
+		size_t count = 0, steps = 0, samples = 0, depth = 0, longest = 0, behind = 0;
+		long long idle = 0;
+		for (size_t active = actors; active; ) {
+			size_t popped = 0, queue = 0;
+			active = 0;
+			for (size_t i = 0; i < actors; i++) {
+				lane& ln = *lanes[i];
+				bool done = ln.done.load(std::memory_order_acquire);
+				size_t size = ln.records.size();
+				queue += size;
+				behind += ln.unlearned.load(std::memory_order_relaxed);
+				for (size_t k = 0; k < size && ln.records.pop(rec); k++, popped++) {
+					if (!rec.end) {
+						paths[i].push_back(rec.step);
+						continue;
+					}
+					if (learner.rate()) learner.learn(paths[i].data(), paths[i].size());
+					learner.weight_agent::close_episode();
+					steps += paths[i].size();
+					paths[i].clear();
+					ln.episodes.pop(ep);
+					ln.unlearned.fetch_sub(1, std::memory_order_release);
+					stats.close_episode(ep);
+					metrics::record(stats.back());
+					count++;
+				}
+				if (!done || ln.records.size()) active++;
+			}
+			samples++;
+			depth += queue;
+			longest = std::max(longest, queue);
+			metrics::global().queued.store(queue, std::memory_order_relaxed);
+			if (popped == 0 && active) {
+				auto wait = clock::now();
+				std::this_thread::yield();
+				idle += usec(clock::now() - wait);
+			}
+		}
+		for (std::thread& worker : workers) worker.join();
+		metrics::global().queued.store(0, std::memory_order_relaxed);
+
+		long long total = std::max(usec(clock::now() - start), 1ll), stall = 0;
+		for (auto& ln : lanes) stall += ln->stall;
+		std::ios ff(nullptr);
+		ff.copyfmt(std::cout);
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << "pipeline: " << actors << " actors, " << count << " episodes (" << steps << " afterstates), ";
+		std::cout << "queue depth = " << (depth * 1.0 / samples) << " (max " << longest << "), ";
+		std::cout << "episodes behind = " << (behind * 1.0 / samples) << ", ";
+		std::cout << "actor stall = " << (stall * 100.0 / (total * actors)) << "%, ";
+		std::cout << "learner idle = " << (idle * 100.0 / total) << "%" << std::endl << std::endl;
+		std::cout.copyfmt(ff);
+	}
+
+protected:
+	typedef std::chrono::steady_clock clock;
+	static long long usec(clock::duration d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); }
+
+	/**
+	 * the rings between an actor and the learner
+	 * the episode ring may hold more than 'stale' episodes since its capacity is a power of two,
+	 * so the limit is enforced by 'unlearned' instead
+	 */
+	struct lane {
+		spsc_ring<record> records;
+		spsc_ring<episode> episodes;
+		std::atomic<size_t> unlearned; // finished episodes not yet learned
+		std::atomic<bool> done;
+		long long stall; // microseconds spent waiting for the learner
+		lane(size_t ring, size_t stale) : records(ring), episodes(stale), unlearned(0), done(false), stall(0) {}
+	};
+
+	/**
+	 * the slider of an actor, which streams the selected transitions to its lane
+	 */
+	class actor : public agent {
+	public:
+		actor(const greedy_slider& policy, lane& ln) : agent("name=" + policy.name() + " role=slider"), policy(policy), ln(ln) {}
+		virtual action take_action(const board& before) {
+			record rec = { {}, false };
+			int op = policy.select(before, rec.step);
+			if (op == -1) return action();
+			push(ln.records, rec, ln);
+			return action::slide(op);
+		}
+	private:
+		const greedy_slider& policy;
+		lane& ln;
+	};
+
+	template<typename T>
+	static void push(spsc_ring<T>& ring, T& item, lane& ln) {
+		if (ring.push(item)) return;
+		auto wait = clock::now();
+		while (!ring.push(item)) std::this_thread::yield();
+		ln.stall += usec(clock::now() - wait);
+	}
+
+	/**
+	 * the actor thread, which plays until no episode remains
+	 */
+	void act(lane& ln, std::atomic<size_t>& remain, std::string place_args) {
+		actor slide(learner, ln);
+		random_placer place(place_args);
+		const std::string game_flag = slide.name() + ":" + place.name();
+		episode game;
+		for (size_t n = remain.load(); n; ) {
+			if (!remain.compare_exchange_weak(n, n - 1)) continue;
+			game.reset();
+			game.open_episode(game_flag);
+			while (true) {
+				agent& who = game.take_turns(slide, place);
+				action move = who.take_action(game.state());
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+			}
+			agent& win = game.last_turns(slide, place);
+			game.close_episode(win.name());
+			record end = { {}, true };
+			if (ln.unlearned.load(std::memory_order_acquire) >= stale) {
+				auto wait = clock::now();
+				while (ln.unlearned.load(std::memory_order_acquire) >= stale) std::this_thread::yield();
+				ln.stall += usec(clock::now() - wait);
+			}
+			ln.unlearned.fetch_add(1, std::memory_order_relaxed);
+			push(ln.episodes, game, ln); // the episode is available once the end is seen
+			push(ln.records, end, ln);
+			n = remain.load();
+		}
+		ln.done.store(true, std::memory_order_release);
+	}
+
+private:
+	greedy_slider& learner;
+	size_t actors;
+	size_t ring;
+	size_t stale;
+};
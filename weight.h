@@ -10,15 +10,119 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <thread>
 #include <utility>
+#include <new>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/**
+ * memory placement policy of lookup tables
+ *
+ * hugetlb: try explicit huge pages (MAP_HUGETLB) before transparent huge pages
+ * interleave: interleave pages over all NUMA nodes, instead of placing each part
+ *             of a table on the node of the thread that first touches it
+ * threads: the number of threads for the first-touch initialization
+ */
+struct placement {
+	bool hugetlb = false;
+	bool interleave = false;
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	static placement& global() { static placement p; return p; }
+};
+
+/**
+ * allocator for large lookup tables
+ * storage of 2MB or larger is mapped 2MB-aligned and backed by huge pages when available,
+ * so that random accesses to a table are not dominated by TLB misses
+ * note that default construction leaves elements uninitialized (mapped pages are zeros),
+ * so that tables can be touched in parallel afterward, see weight::touch
+ */
+template<typename T>
+class table_allocator {
+public:
+	typedef T value_type;
+	static constexpr size_t huge_page = 2 << 20;
+
+	table_allocator() = default;
+	template<typename U> table_allocator(const table_allocator<U>&) {}
+
+	/**
+	 * whether storage of n elements is mapped, i.e., its pages are initially zeros
+	 */
+	static bool mapped(size_t n) { return n * sizeof(T) >= huge_page; }
+
+	T* allocate(size_t n) {
+		size_t len = n * sizeof(T);
+		if (!mapped(n)) return static_cast<T*>(::operator new(len));
+		len = round_up(len);
+		void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if (placement::global().hugetlb)
+			ptr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (ptr == MAP_FAILED) ptr = map_aligned(len);
+		if (ptr == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+		::madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+		if (placement::global().interleave) interleave(ptr, len);
+		return static_cast<T*>(ptr);
+	}
+	void deallocate(T* ptr, size_t n) {
+		if (!mapped(n)) return ::operator delete(ptr);
+		::munmap(ptr, round_up(n * sizeof(T)));
+	}
+
+	template<typename U> void construct(U* ptr) { ::new(static_cast<void*>(ptr)) U; }
+	template<typename U, typename... Args> void construct(U* ptr, Args&&... args) {
+		::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+	}
+
+	template<typename U> bool operator ==(const table_allocator<U>&) const { return true; }
+	template<typename U> bool operator !=(const table_allocator<U>&) const { return false; }
+
+protected:
+	static size_t round_up(size_t len) { return (len + huge_page - 1) & ~(huge_page - 1); }
+
+	/**
+	 * map 'len' bytes aligned to huge pages, by over-mapping and trimming both ends
+	 */
+	static void* map_aligned(size_t len) {
+		void* raw = ::mmap(nullptr, len + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED) return raw;
+		uintptr_t base = reinterpret_cast<uintptr_t>(raw);
+		uintptr_t head = round_up(base);
+		if (head > base) ::munmap(raw, head - base);
+		if (base + huge_page > head) ::munmap(reinterpret_cast<void*>(head + len), base + huge_page - head);
+		return reinterpret_cast<void*>(head);
+	}
+
+	/**
+	 * set the interleave policy over all allowed NUMA nodes, failures are ignored
+	 */
+	static void interleave(void* ptr, size_t len) {
+#ifdef SYS_mbind
+		const int mpol_interleave = 3;
+		unsigned long nodes = -1ul;
+		::syscall(SYS_mbind, ptr, len, mpol_interleave, &nodes, sizeof(nodes) * 8, 0);
+#endif
+	}
+};
 
 class weight {
 public:
 	typedef float type;
+	typedef std::vector<type, table_allocator<type>> storage;
 
 public:
 	weight() {}
-	weight(size_t len) : value(len) {}
+	weight(size_t len) : value(len) { touch(); }
 	weight(weight&& f) : value(std::move(f.value)) {}
 	weight(const weight& f) = default;
 
@@ -27,6 +131,35 @@ public:
 	const type& operator[] (size_t i) const { return value[i]; }
 	size_t size() const { return value.size(); }
 
+	/**
+	 * relaxed atomic access to an entry, for tables read by some threads while another one writes,
+	 * e.g., the actors and the learner of pipeline_trainer; these are plain moves on x86-64
+	 */
+	type load(size_t i) const { type v; __atomic_load(&value[i], &v, __ATOMIC_RELAXED); return v; }
+	void store(size_t i, type v) { __atomic_store(&value[i], &v, __ATOMIC_RELAXED); }
+
+	/**
+	 * zero-fill the table with multiple threads, each touching a contiguous part first,
+	 * so that pages are faulted in parallel and placed near the threads
+	 * mapped storage is already zeros, so writing once per page is sufficient
+	 */
+	void touch(unsigned threads = placement::global().threads) {
+		size_t size = value.size();
+		threads = std::max(std::min<size_t>(threads, size >> 20), size_t(1));
+		auto zero = [this, size, threads](size_t i) {
+			size_t head = size * i / threads, tail = size * (i + 1) / threads;
+			if (table_allocator<type>::mapped(value.capacity())) {
+				for (size_t k = head; k < tail; k += 4096 / sizeof(type)) value[k] = 0;
+			} else {
+				std::memset(value.data() + head, 0, sizeof(type) * (tail - head));
+			}
+		};
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < threads; i++) workers.emplace_back(zero, i);
+		zero(0);
+		for (std::thread& worker : workers) worker.join();
+	}
+
 public:
 	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
 		auto& value = w.value;
@@ -40,10 +173,11 @@ public:
 		uint64_t size = 0;
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
 		value.resize(size);
+		w.touch();
 		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * size);
 		return in;
 	}
 
 protected:
-	std::vector<type> value;
+	storage value;
 };